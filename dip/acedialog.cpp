@@ -1,4 +1,5 @@
 #include "acedialog.h"
+#include "artifactcache.h"
 
 ACEDialog::ACEDialog(QImage inputImage)
 {
@@ -6,28 +7,17 @@ ACEDialog::ACEDialog(QImage inputImage)
 
     int image_width = srcImage.width();    // obtain srcImage width
     int image_height = srcImage.height();    // obtain srcImage height
-    int ori_pixel_num = image_width*image_height;    // obtain original pixel number
-
-    int pixel_num = (image_width+2*maxFilterSize)*(image_height+2*maxFilterSize);    // ?
-
-    // obtain image channels
-    rgb = new float[3*ori_pixel_num]; //
-    rgb_pad = new float[3*pixel_num];
-    rgb_ii = new float[3*pixel_num];
-    rgb_ii_power = new float[3*pixel_num];
-    splitImageChannel(srcImage, rgb, rgb+ori_pixel_num, rgb+2*ori_pixel_num);
-    paddingZeros(rgb, rgb+ori_pixel_num, rgb+2*ori_pixel_num, image_width, image_height,
-                 maxFilterSize, maxFilterSize, rgb_pad, rgb_pad+pixel_num, rgb_pad+2*pixel_num);
-    for (int i=0; i<3; i++)
-    {
-        //calculate_integral_image(rgb+i*pixel_num, image_width, image_height, rgb_ii+i*pixel_num);
-        //calculate_integral_image_power(rgb+i*pixel_num, image_width, image_height, rgb_ii_power+i*pixel_num);
-        calculate_integral_image(rgb_pad+i*pixel_num, image_width+2*maxFilterSize,
-                                 image_height+2*maxFilterSize, rgb_ii+i*pixel_num);
-        calculate_integral_image_power(rgb_pad+i*pixel_num, image_width+2*maxFilterSize,
-                                       image_height+2*maxFilterSize, rgb_ii_power+i*pixel_num);
-    }
-    adaptiveContrastEnhancement(srcImage, rgb_pad, rgb_ii, rgb_ii_power, maxFilterSize,
+
+    int pixel_num = image_width*image_height;
+
+    // image channels and their integral images, shared with the cache and reused when the dialog is opened
+    // again on the same image; the window border is zero padded virtually, so no padded copies are needed
+    cn = imageChannelCount(srcImage);    // one plane only for gray images
+    integrals = ArtifactCache::instance().integralImages(srcImage, 0);
+    rgb = (const float *)integrals.constData();
+    rgb_ii = rgb + cn*pixel_num;
+    rgb_ii_power = rgb + 2*cn*pixel_num;
+    adaptiveContrastEnhancement(srcImage, cn, rgb, rgb_ii, rgb_ii_power,
                                 filterSize,  gainCoef, maxCG, dstImage);
 
     iniUI();
@@ -162,7 +152,7 @@ void ACEDialog::updateDstImage(float value)
         maxCGEdit->setText(QString("%1").arg(value));
     }
 
-    adaptiveContrastEnhancement(srcImage, rgb_pad, rgb_ii, rgb_ii_power, maxFilterSize,
+    adaptiveContrastEnhancement(srcImage, cn, rgb, rgb_ii, rgb_ii_power,
                                 filterSize,  gainCoef, maxCG, dstImage);
     dstImageLabel->setPixmap(QPixmap::fromImage(dstImage));
 }
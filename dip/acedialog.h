@@ -12,6 +12,7 @@
 #include <QLineEdit>
 #include <QPushButton>
 #include <QImage>
+#include <QByteArray>
 #include "imageprocess.h"
 #include "floatslider.h"
 
@@ -35,25 +36,15 @@ class ACEDialog : public QDialog
     Q_OBJECT
 public:
     ACEDialog(QImage inputImage);
-    ~ACEDialog()
-    {
-        if (rgb)
-            delete [] rgb;
-        if (rgb_pad)
-            delete [] rgb_pad;
-        if (rgb_ii)
-            delete [] rgb_ii;
-        if (rgb_ii_power)
-            delete [] rgb_ii_power;
-    }
     QImage getImage() {return dstImage;}
 private:
     void iniUI();
     QImage srcImage;
-    float *rgb = nullptr;
-    float *rgb_pad = nullptr;
-    float *rgb_ii = nullptr;
-    float *rgb_ii_power = nullptr;
+    int cn = 3;
+    QByteArray integrals;   // planes, integral images and squared integral images, see ArtifactCache::integralImages()
+    const float *rgb = nullptr;
+    const float *rgb_ii = nullptr;
+    const float *rgb_ii_power = nullptr;
     QImage dstImage;
     QLabel *srcImageLabel;
     QLabel *dstImageLabel;
@@ -0,0 +1,308 @@
+#include "artifactcache.h"
+#include "transform.h"
+#include "padding.h"
+#include "scratcharena.h"
+
+ArtifactCache::ArtifactCache()
+{
+    entries.setMaxCost(256*1024);   // 256 MB
+}
+
+ArtifactCache &ArtifactCache::instance()
+{
+    static ArtifactCache cache;
+    return cache;
+}
+
+void ArtifactCache::setMaxCost(int kiloBytes)
+{
+    QMutexLocker locker(&mutex);
+    entries.setMaxCost(kiloBytes);
+    ScratchArena::setResidentBytes(entries.totalCost() * 1024ll);
+}
+
+int ArtifactCache::maxCost()
+{
+    QMutexLocker locker(&mutex);
+    return entries.maxCost();
+}
+
+void ArtifactCache::clear()
+{
+    QMutexLocker locker(&mutex);
+    entries.clear();
+    ScratchArena::setResidentBytes(0);
+}
+
+ArtifactCache::Key ArtifactCache::key(const QImage &image, Kind kind, int param)
+{
+    Key k;
+    k.image = image.cacheKey();
+    k.kind = kind;
+    k.param = param;
+    return k;
+}
+
+bool ArtifactCache::find(const Key &k, Entry &entry)
+{
+    QMutexLocker locker(&mutex);
+    Entry *e = entries.object(k);   // also marks the entry as most recently used
+    if (!e)
+        return false;
+    entry = *e;
+    return true;
+}
+
+// the artifact is computed outside the lock, two threads may compute the same one and the last insert wins,
+// the entries count against the scratch memory budget
+void ArtifactCache::insert(const Key &k, const Entry &entry)
+{
+    int cost = (int)((entry.image.sizeInBytes() + entry.data.size()) / 1024) + 1;
+    QMutexLocker locker(&mutex);
+    entries.insert(k, new Entry(entry), cost);
+    ScratchArena::setResidentBytes(entries.totalCost() * 1024ll);
+}
+
+QImage ArtifactCache::grayImage(const QImage &image)
+{
+    Key k = key(image, GrayImage);
+    Entry entry;
+    if (!find(k, entry))
+    {
+        entry.image = image.convertToFormat(QImage::Format_Grayscale8);
+        insert(k, entry);
+    }
+    return entry.image;
+}
+
+// 1 if all pixels are gray, 3 otherwise, QImage::allGray() reads the whole image
+int ArtifactCache::channelCount(const QImage &image)
+{
+    Key k = key(image, ChannelCount);
+    Entry entry;
+    if (!find(k, entry))
+    {
+        entry.data = QByteArray(1, image.allGray() ? 1 : 3);
+        insert(k, entry);
+    }
+    return entry.data.at(0);
+}
+
+/*
+*Summary: channels of the image as float planes
+*Return:
+*    cn*w*h floats (cn from imageChannelCount()), the gray plane or the r, g and b planes
+*/
+
+QByteArray ArtifactCache::floatPlanes(const QImage &image)
+{
+    Key k = key(image, FloatPlanes);
+    Entry entry;
+    if (!find(k, entry))
+    {
+        int cn = imageChannelCount(image);
+        QImage src = image;
+        entry.data = QByteArray(cn*image.width()*image.height()*sizeof(float), Qt::Uninitialized);
+        splitImagePlanes(src, (float *)entry.data.data(), cn);
+        insert(k, entry);
+    }
+    return entry.data;
+}
+
+/*
+*Summary: histogram of one image channel
+*Return:
+*    256 ints, the Y channel is taken from the Grayscale8 conversion of the image
+*/
+
+QByteArray ArtifactCache::histogram(const QImage &image, ImageChannel channel)
+{
+    Key k = key(image, Histogram, channel);
+    Entry entry;
+    if (!find(k, entry))
+    {
+        entry.data = QByteArray(256*sizeof(int), 0);
+        int *hist = (int *)entry.data.data();
+        int width = image.width();
+        int height = image.height();
+        if (channel == ImageChannel::Y)
+        {
+            QImage gray = grayImage(image);
+            for (int j=0; j<height; j++)
+            {
+                const uchar *p = gray.constScanLine(j);
+                for (int i=0; i<width; i++)
+                    hist[p[i]]++;
+            }
+        }
+        else
+        {
+            QImage rgb = image.convertToFormat(QImage::Format_RGB32);
+            for (int j=0; j<height; j++)
+            {
+                const QRgb *p = (const QRgb *)rgb.constScanLine(j);
+                for (int i=0; i<width; i++)
+                {
+                    int val = channel == ImageChannel::R ? qRed(p[i]) :
+                              channel == ImageChannel::G ? qGreen(p[i]) : qBlue(p[i]);
+                    hist[val]++;
+                }
+            }
+        }
+        insert(k, entry);
+    }
+    return entry.data;
+}
+
+/*
+*Summary: zero padded float planes and their integral images
+*Parameters:
+*    const QImage &image : input image
+*    int pad : number of zero pixels added on each side
+*Return:
+*    three blocks of cn*(w+2*pad)*(h+2*pad) floats : the padded planes (see floatPlanes()),
+*    their integral images and the integral images of their squares
+*/
+
+QByteArray ArtifactCache::integralImages(const QImage &image, int pad)
+{
+    Key k = key(image, IntegralImages, pad);
+    Entry entry;
+    if (!find(k, entry))
+    {
+        int width = image.width();
+        int height = image.height();
+        int n = width*height;
+        int pw = width+2*pad;
+        int ph = height+2*pad;
+        int pn = pw*ph;
+        int cn = imageChannelCount(image);
+
+        QByteArray planes = floatPlanes(image);
+        const float *rgb = (const float *)planes.constData();
+        entry.data = QByteArray(3*cn*pn*sizeof(float), Qt::Uninitialized);
+        float *rgb_pad = (float *)entry.data.data();
+        float *rgb_ii = rgb_pad + cn*pn;
+        float *rgb_ii_power = rgb_pad + 2*cn*pn;
+        const float zero = 0;
+        for (int c=0; c<cn; c++)
+        {
+            copyMakeBorder(rgb+c*n, width, height, 1, pad, pad, pad, pad, BORDER_CONSTANT, &zero, rgb_pad+c*pn);
+            calculate_integral_image(rgb_pad+c*pn, pw, ph, rgb_ii+c*pn);
+            calculate_integral_image_power(rgb_pad+c*pn, pw, ph, rgb_ii_power+c*pn);
+        }
+        insert(k, entry);
+    }
+    return entry.data;
+}
+
+/*
+*Summary: exact integral images of the gray image
+*Return:
+*    (w+1)*(h+1) quint64 sums of squares followed by (w+1)*(h+1) quint32 sums
+*/
+
+QByteArray ArtifactCache::exactIntegralImages(const QImage &image)
+{
+    Key k = key(image, ExactIntegralImages);
+    Entry entry;
+    if (!find(k, entry))
+    {
+        int n = (image.width()+1)*(image.height()+1);
+        entry.data = QByteArray(n*(sizeof(quint64)+sizeof(quint32)), Qt::Uninitialized);
+        quint64 *ii_power = (quint64 *)entry.data.data();
+        calculate_exact_integral_images(grayImage(image), (quint32 *)(ii_power + n), ii_power);
+        insert(k, entry);
+    }
+    return entry.data;
+}
+
+QByteArray ArtifactCache::distanceTransform(const QImage &image)
+{
+    Key k = key(image, DistanceTransform);
+    Entry entry;
+    if (!find(k, entry))
+    {
+        entry.data = QByteArray(image.width()*image.height()*sizeof(float), Qt::Uninitialized);
+        ::distanceTransform(image, (float *)entry.data.data());
+        insert(k, entry);
+    }
+    return entry.data;
+}
+
+/*
+*Summary: luma and chroma of a color image
+*Return:
+*    3*w*h floats, the y, cr and cb planes converted from floatPlanes()
+*/
+
+QByteArray ArtifactCache::lumaChromaPlanes(const QImage &image)
+{
+    Key k = key(image, LumaChromaPlanes);
+    Entry entry;
+    if (!find(k, entry))
+    {
+        int n = image.width()*image.height();
+        QByteArray planes = floatPlanes(image);
+        const float *rgb = (const float *)planes.constData();
+        entry.data = QByteArray(3*n*sizeof(float), Qt::Uninitialized);
+        float *ycrcb = (float *)entry.data.data();
+        rgb2ycrcb(rgb, rgb+n, rgb+2*n, n, ycrcb, ycrcb+n, ycrcb+2*n);
+        insert(k, entry);
+    }
+    return entry.data;
+}
+
+/*
+*Summary: fftshifted 2D spectrum of the float planes
+*Parameters:
+*    bool luma : transform only the y plane of a color image (see lumaChromaPlanes()),
+*                gray images have a single plane anyway
+*Return:
+*    cn*pw*ph fftwf_complex, one spectrum per plane (see floatPlanes()), pw and ph from
+*    fftPaddedSize(), the planes are padded by padPlanesForFFT()
+*/
+
+QByteArray ArtifactCache::shiftedSpectrum(const QImage &image, bool luma)
+{
+    int cn = imageChannelCount(image);
+    luma = luma && cn == 3;
+    Key k = key(image, ShiftedSpectrum, luma);
+    Entry entry;
+    if (!find(k, entry))
+    {
+        int w, h;
+        fftPaddedSize(image.width(), image.height(), w, h);
+        int n = w*h;
+        QByteArray planes = luma ? lumaChromaPlanes(image) : floatPlanes(image);
+        cn = luma ? 1 : cn;
+        ScratchScope scratch("shiftedSpectrum");
+        float *padded = scratch.alloc<float>(cn*n);
+        padPlanesForFFT((const float *)planes.constData(), image.width(), image.height(), cn, w, h, padded);
+        fftwf_complex *y = scratch.alloc<fftwf_complex>(cn*n);
+        fftw2d(padded, w, h, cn, y);
+
+        entry.data = QByteArray(cn*n*sizeof(fftwf_complex), Qt::Uninitialized);
+        fftshift2D(y, w, h, cn, (fftwf_complex *)entry.data.data());
+        insert(k, entry);
+    }
+    return entry.data;
+}
+
+QImage ArtifactCache::spectrumImage(const QImage &image, bool luma)
+{
+    int cn = imageChannelCount(image);
+    luma = luma && cn == 3;
+    Key k = key(image, SpectrumImage, luma);
+    Entry entry;
+    if (!find(k, entry))
+    {
+        // at the transform size, see shiftedSpectrum()
+        int w, h;
+        fftPaddedSize(image.width(), image.height(), w, h);
+        QByteArray spectrum = shiftedSpectrum(image, luma);
+        spectrum2QImage((const fftwf_complex *)spectrum.constData(), w, h, luma ? 1 : cn, entry.image);
+        insert(k, entry);
+    }
+    return entry.image;
+}
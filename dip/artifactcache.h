@@ -0,0 +1,86 @@
+#ifndef ARTIFACTCACHE_H
+#define ARTIFACTCACHE_H
+
+#include <QImage>
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+#include <QHash>
+#include "imageprocess.h"
+
+/*
+ * Memory-bounded LRU cache of data derived from an image (gray image, planar float
+ * channels, histograms, integral images, spectrum). Entries are keyed by
+ * QImage::cacheKey(), which changes whenever the pixels of an image change, plus the
+ * kind of artifact and its parameter, so stale entries are never returned and simply
+ * age out. Values are implicitly shared, a lookup never copies pixel data.
+ * The cache is shared by the whole application and may be used from worker threads.
+ */
+class ArtifactCache
+{
+public:
+    enum Kind
+    {
+        GrayImage = 0,      // Format_Grayscale8 conversion
+        FloatPlanes,        // gray or r, g, b planes as float, w*h each
+        Histogram,          // 256 ints, parameter is the ImageChannel
+        IntegralImages,     // padded planes, integral and squared integral images, parameter is the padding
+        ExactIntegralImages,    // integer integral images of the gray image, see calculate_exact_integral_images()
+        DistanceTransform,      // w*h float euclidean distances to the background, see distanceTransform()
+        ShiftedSpectrum,    // fftshifted 2D FFT of the float planes at the size from fftPaddedSize(), fftwf_complex,
+                            // parameter 1 for the luma plane only
+        SpectrumImage,      // log magnitude of the shifted spectrum, parameter as for ShiftedSpectrum
+        LumaChromaPlanes,   // y, cr and cb planes as float, w*h each, see rgb2ycrcb()
+        ChannelCount        // one byte, see imageChannelCount()
+    };
+
+    static ArtifactCache &instance();
+
+    void setMaxCost(int kiloBytes);
+    int maxCost();
+    void clear();
+
+    QImage grayImage(const QImage &image);
+    int channelCount(const QImage &image);
+    QByteArray floatPlanes(const QImage &image);
+    QByteArray histogram(const QImage &image, ImageChannel channel);
+    QByteArray integralImages(const QImage &image, int pad);
+    QByteArray exactIntegralImages(const QImage &image);
+    QByteArray distanceTransform(const QImage &image);
+    QByteArray lumaChromaPlanes(const QImage &image);
+    QByteArray shiftedSpectrum(const QImage &image, bool luma = false);
+    QImage spectrumImage(const QImage &image, bool luma = false);
+
+private:
+    ArtifactCache();
+
+    struct Key
+    {
+        qint64 image;
+        int kind;
+        int param;
+        bool operator==(const Key &other) const
+        {
+            return image == other.image && kind == other.kind && param == other.param;
+        }
+        friend uint qHash(const Key &k, uint seed = 0)
+        {
+            return ::qHash(k.image, seed) ^ (uint)(k.kind << 24) ^ (uint)k.param;
+        }
+    };
+
+    struct Entry
+    {
+        QImage image;
+        QByteArray data;
+    };
+
+    static Key key(const QImage &image, Kind kind, int param = 0);
+    bool find(const Key &k, Entry &entry);
+    void insert(const Key &k, const Entry &entry);
+
+    QMutex mutex;
+    QCache<Key, Entry> entries;     // cost in KB
+};
+
+#endif // ARTIFACTCACHE_H
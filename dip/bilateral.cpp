@@ -0,0 +1,161 @@
+#include "bilateral.h"
+#include "imageprocess.h"
+#include "artifactcache.h"
+#include "scratcharena.h"
+
+/*
+*Summary: [1 4 6 4 1]/16 blur along one axis of the grid
+*Parameters:
+*    float *grid : total floats
+*    int total : grid size
+*    int n : number of cells along the axis
+*    int stride : distance of neighbouring cells along the axis
+*Describtion:
+*    The lines start at every offset whose coordinate on the axis is 0, cells outside the grid are 0.
+*/
+
+static void blurGridAxis(float *grid, int total, int n, int stride)
+{
+    int lines = total / n;
+#pragma omp parallel
+    {
+        ScratchScope scratch;
+        float *line = scratch.alloc<float>(n+4);
+        line[0] = line[1] = line[n+2] = line[n+3] = 0;
+#pragma omp for
+        for (int l=0; l<lines; l++)
+        {
+            float *p = grid + (l / stride) * n * stride + l % stride;
+            for (int i=0; i<n; i++)
+                line[i+2] = p[i*stride];
+            for (int i=0; i<n; i++)
+                p[i*stride] = (line[i] + 4*line[i+1] + 6*line[i+2] + 4*line[i+3] + line[i+4]) * (1.0f/16);
+        }
+    }
+}
+
+/*
+*Summary: bilateral filter through a bilateral grid
+*Parameters:
+*    const QImage &image : input image
+*    float sigma_s : spatial standard deviation in pixels
+*    float sigma_r : range standard deviation in gray values
+*    uchar *dst : output w*h*cn interleaved values, see concatenateImageChannel()
+*Describtion:
+*    (1) Splat: every pixel adds its channel values and a weight of 1 to the cell (x/sigma_s,
+*        y/sigma_s, luma/sigma_r) of a 3D grid. Grid rows are independent, they are filled in parallel.
+*    (2) Blur: a separable [1 4 6 4 1]/16 kernel (about one cell of standard deviation) along x, y and luma.
+*    (3) Slice: the values and the weight are interpolated trilinearly at every pixel's position
+*        and divided. Color images are filtered with the luma as the edge image.
+*    The grid has about w*h/sigma_s^2 * 256/sigma_r cells, so the cost is linear in the number of
+*    pixels and shrinks as sigma_s grows. The blur along y needs the whole grid, so it is borrowed
+*    in one piece from the scratch arena and counts against the memory budget.
+*/
+
+void bilateralFilter(const QImage &image, float sigma_s, float sigma_r, uchar *dst)
+{
+    int w = image.width();
+    int h = image.height();
+    int n = w*h;
+    int cn = imageChannelCount(image);
+    int values = cn + 1;        // channel sums and the weight
+    const int pad = 2;          // the blur kernel radius, the splatted cells spread into the padding
+
+    QImage gray = ArtifactCache::instance().grayImage(image);
+    QByteArray cached = ArtifactCache::instance().floatPlanes(image);
+    const float *planes = (const float *)cached.constData();
+
+    int gw = (int)((w-1) / sigma_s + 0.5f) + 1 + 2*pad;
+    int gh = (int)((h-1) / sigma_s + 0.5f) + 1 + 2*pad;
+    int gd = (int)(255 / sigma_r + 0.5f) + 1 + 2*pad;
+    int cell_stride = values;
+    int x_stride = gd * cell_stride;
+    int y_stride = gw * x_stride;
+    ScratchScope scratch;
+    float *grid = scratch.alloc<float>(gh * y_stride);
+    memset(grid, 0, gh * y_stride * sizeof(float));
+
+    // (1) splat, the pixel rows of grid row gy are round(y/sigma_s) == gy-pad
+#pragma omp parallel for
+    for (int gy=pad; gy<gh-pad; gy++)
+    {
+        int y0 = qMax(0, (int)floorf((gy - pad - 0.5f) * sigma_s));
+        int y1 = qMin(h, (int)ceilf((gy - pad + 0.5f) * sigma_s) + 1);
+        for (int y=y0; y<y1; y++)
+        {
+            if ((int)(y / sigma_s + 0.5f) + pad != gy)
+                continue;
+            const uchar *g = gray.constScanLine(y);
+            for (int x=0; x<w; x++)
+            {
+                int gx = (int)(x / sigma_s + 0.5f) + pad;
+                int gz = (int)(g[x] / sigma_r + 0.5f) + pad;
+                float *cell = grid + gy*y_stride + gx*x_stride + gz*cell_stride;
+                for (int c=0; c<cn; c++)
+                    cell[c] += planes[c*n + y*w + x];
+                cell[cn] += 1;
+            }
+        }
+    }
+
+    // (2) blur along luma, x and y
+    int total = gh*y_stride;
+    blurGridAxis(grid, total, gd, cell_stride);
+    blurGridAxis(grid, total, gw, x_stride);
+    blurGridAxis(grid, total, gh, y_stride);
+
+    // (3) slice
+#pragma omp parallel for
+    for (int y=0; y<h; y++)
+    {
+        float fy = y / sigma_s + pad;
+        int y0 = (int)fy;
+        float wy = fy - y0;
+        const uchar *g = gray.constScanLine(y);
+        for (int x=0; x<w; x++)
+        {
+            float fx = x / sigma_s + pad;
+            float fz = g[x] / sigma_r + pad;
+            int x0 = (int)fx;
+            int z0 = (int)fz;
+            float wx = fx - x0;
+            float wz = fz - z0;
+
+            float acc[4] = {0, 0, 0, 0};
+            for (int k=0; k<8; k++)
+            {
+                int dy = k >> 2, dx = (k >> 1) & 1, dz = k & 1;
+                float weight = (dy ? wy : 1-wy) * (dx ? wx : 1-wx) * (dz ? wz : 1-wz);
+                const float *cell = grid + (y0+dy)*y_stride + (x0+dx)*x_stride + (z0+dz)*cell_stride;
+                for (int c=0; c<values; c++)
+                    acc[c] += weight * cell[c];
+            }
+            for (int c=0; c<cn; c++)
+            {
+                float val = acc[cn] > 0 ? acc[c] / acc[cn] : planes[c*n + y*w + x];
+                dst[(y*w+x)*cn+c] = (uchar)qBound(0.0f, val + 0.5f, 255.0f);
+            }
+        }
+    }
+}
+
+/*
+*Summary: bilateral filter of an image
+*Return:
+*    Format_Grayscale8 image for gray input, Format_RGB888 image otherwise
+*/
+
+QImage bilateralFilter(const QImage &image, float sigma_s, float sigma_r)
+{
+    int w = image.width();
+    int h = image.height();
+    int cn = imageChannelCount(image);
+
+    ScratchScope scratch("bilateralFilter");
+    uchar *filtered = scratch.alloc<uchar>(w*h*cn);
+    bilateralFilter(image, sigma_s, sigma_r, filtered);
+
+    QImage dst;
+    concatenateImageChannel(filtered, w, h, cn, dst);
+    return dst;
+}
@@ -0,0 +1,9 @@
+#ifndef BILATERAL_H
+#define BILATERAL_H
+
+#include <QImage>
+
+void bilateralFilter(const QImage &image, float sigma_s, float sigma_r, uchar *dst);
+QImage bilateralFilter(const QImage &image, float sigma_s, float sigma_r);
+
+#endif // BILATERAL_H
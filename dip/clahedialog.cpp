@@ -0,0 +1,104 @@
+#include "clahedialog.h"
+
+ClaheDialog::ClaheDialog(QImage inputImage)
+{
+    srcImage = inputImage;
+
+    dstImage = contrastLimitedEqualization(srcImage, tiles, tiles, clipLimit);
+
+    iniUI();
+
+    srcImageLabel->setPixmap(QPixmap::fromImage(srcImage));
+    dstImageLabel->setPixmap(QPixmap::fromImage(dstImage));
+}
+
+void ClaheDialog::iniUI()
+{
+    // two image labels
+    srcImageLabel = new QLabel();
+    srcImageLabel->setAlignment(Qt::AlignCenter);
+    dstImageLabel = new QLabel();
+    dstImageLabel->setAlignment(Qt::AlignCenter);
+
+    // tile grid size
+    tilesLabel = new QLabel(tr("Tiles"));
+    tilesSlider = new FloatSlider(Qt::Horizontal);
+    tilesEdit = new QLineEdit();
+    tilesLabel->setMinimumWidth(30);
+    tilesLabel->setAlignment(Qt::AlignRight);
+    tilesEdit->setMinimumWidth(16);
+    tilesSlider->setFloatRange(1, 32);
+    tilesSlider->setFloatStep(1);
+    tilesSlider->setFloatValue(tiles);
+    tilesEdit->setText(QString("%1").arg(tiles));
+
+    // clip limit
+    clipLimitLabel = new QLabel(tr("Clip Limit"));
+    clipLimitSlider = new FloatSlider(Qt::Horizontal);
+    clipLimitEdit = new QLineEdit();
+    clipLimitLabel->setMinimumWidth(30);
+    clipLimitLabel->setAlignment(Qt::AlignRight);
+    clipLimitEdit->setMinimumWidth(16);
+    clipLimitSlider->setFloatRange(1, 10);
+    clipLimitSlider->setFloatStep(0.1f);
+    clipLimitSlider->setFloatValue(clipLimit);
+    clipLimitEdit->setText(QString::number(clipLimit, 'f', 2));
+
+    // signal slot
+    connect(tilesSlider, SIGNAL(floatValueChanged(float)), this, SLOT(updateDstImage(float)));
+    connect(clipLimitSlider, SIGNAL(floatValueChanged(float)), this, SLOT(updateDstImage(float)));
+
+    // three buttons
+    btnOK = new QPushButton(tr("OK"));
+    btnCancel = new QPushButton(tr("Cancel"));
+    btnClose = new QPushButton(tr("Exit"));
+
+    connect(btnOK, SIGNAL(clicked()), this, SLOT(accept()));
+    connect(btnCancel, SIGNAL(clicked()), this, SLOT(reject()));
+    connect(btnClose, SIGNAL(clicked()), this, SLOT(close()));
+
+    QHBoxLayout *layout1 = new QHBoxLayout;
+    layout1->addWidget(srcImageLabel);
+    layout1->addWidget(dstImageLabel);
+
+    QHBoxLayout *layout2 = new QHBoxLayout;
+    layout2->addWidget(tilesLabel, 3);
+    layout2->addWidget(tilesSlider, 5);
+    layout2->addWidget(tilesEdit, 2);
+    layout2->addStretch();
+
+    layout2->addWidget(clipLimitLabel, 3);
+    layout2->addWidget(clipLimitSlider, 5);
+    layout2->addWidget(clipLimitEdit, 2);
+
+    QHBoxLayout *layout3=new QHBoxLayout;
+    layout3->addStretch();
+    layout3->addWidget(btnOK);
+    layout3->addWidget(btnCancel);
+    layout3->addStretch();
+    layout3->addWidget(btnClose);
+
+    // main layout
+    QVBoxLayout *mainlayout = new QVBoxLayout;
+    mainlayout->addLayout(layout1, 8);
+    mainlayout->addLayout(layout2, 1);
+    mainlayout->addLayout(layout3, 1);
+    setLayout(mainlayout);
+}
+
+void ClaheDialog::updateDstImage(float value)
+{
+    if (QObject::sender() == tilesSlider)
+    {
+        tiles = (int)value;
+        tilesEdit->setText(QString("%1").arg(tiles));
+    }
+    else if (QObject::sender() == clipLimitSlider)
+    {
+        clipLimit = value;
+        clipLimitEdit->setText(QString::number(value, 'f', 2));
+    }
+
+    dstImage = contrastLimitedEqualization(srcImage, tiles, tiles, clipLimit);
+    dstImageLabel->setPixmap(QPixmap::fromImage(dstImage));
+}
@@ -0,0 +1,58 @@
+#ifndef CLAHEDIALOG_H
+#define CLAHEDIALOG_H
+
+#include <QDialog>
+#include <QLabel>
+#include <QSlider>
+#include <QBoxLayout>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QImage>
+#include "imageprocess.h"
+#include "floatslider.h"
+
+QT_BEGIN_NAMESPACE
+class QLabel;
+class QSlider;
+class QLineEdit;
+class QPushButton;
+class QBoxLayout;
+class QHBoxLayout;
+class QVBoxLayout;
+QT_END_NAMESPACE
+
+class ClaheDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    ClaheDialog(QImage inputImage);
+    QImage getImage() {return dstImage;}
+private:
+    void iniUI();
+    QImage srcImage;
+    QImage dstImage;
+    QLabel *srcImageLabel;
+    QLabel *dstImageLabel;
+
+    FloatSlider *tilesSlider;
+    QLineEdit *tilesEdit;
+    QLabel *tilesLabel;
+
+    FloatSlider *clipLimitSlider;
+    QLineEdit *clipLimitEdit;
+    QLabel *clipLimitLabel;
+
+    QPushButton     *btnOK;
+    QPushButton     *btnCancel;
+    QPushButton     *btnClose;
+
+    int tiles = 8;
+    float clipLimit = 2.0f;
+
+private slots:
+    void updateDstImage(float value);
+};
+
+#endif // CLAHEDIALOG_H
@@ -81,6 +81,14 @@ void CloseDialog::Closing(QImage &src_image, QImage &dst_image)
         { 1,1,1,1,1,1,1 },
         { 1,1,1,1,1,1,1 } };
     int sizeKernel = 7;
+    // gray image: single channel dilation and erosion, Format_Grayscale8 result
+    if (imageChannelCount(src_image) == 1)
+    {
+        QImage gray_temp;
+        grayMorphology(src_image, &kernel[0][0], sizeKernel, true, gray_temp);
+        grayMorphology(gray_temp, &kernel[0][0], sizeKernel, false, dst_image);
+        return;
+    }
     QColor color;
 
     /*dilation operation*/
@@ -0,0 +1,488 @@
+#include "convolution.h"
+#include "imageprocess.h"
+#include "artifactcache.h"
+#include "scratcharena.h"
+#include "transform.h"
+#include <QElapsedTimer>
+#include <QVector>
+#include <math.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// smallest length >= n whose only prime factors are 2, 3, 5 and 7, FFTW is fastest for those
+int optimalFFTSize(int n)
+{
+    static const int primes[4] = {2, 3, 5, 7};
+    for (int m=qMax(n, 1); ; m++)
+    {
+        int r = m;
+        for (int p=0; p<4; p++)
+            while (r % primes[p] == 0)
+                r /= primes[p];
+        if (r == 1)
+            return m;
+    }
+}
+
+/*
+*Summary: split a rank one kernel into a column and a row
+*Parameters:
+*    const float *kernel : kh rows of kw weights
+*    float *column : output kh weights
+*    float *row : output kw weights, kernel[n*kw+m] == column[n]*row[m]
+*Return:
+*    false if the kernel is not separable
+*/
+
+bool separateKernel(const float *kernel, int kw, int kh, float *column, float *row)
+{
+    int p = 0;
+    for (int i=1; i<kw*kh; i++)
+        p = fabs(kernel[i]) > fabs(kernel[p]) ? i : p;
+    float pivot = kernel[p];
+    if (pivot == 0)
+        return false;
+
+    int py = p / kw;
+    int px = p % kw;
+    for (int m=0; m<kw; m++)
+        row[m] = kernel[py*kw+m];
+    for (int n=0; n<kh; n++)
+        column[n] = kernel[n*kw+px] / pivot;
+
+    float tolerance = 1e-5f*fabs(pivot);
+    for (int n=0; n<kh; n++)
+        for (int m=0; m<kw; m++)
+            if (fabs(kernel[n*kw+m] - column[n]*row[m]) > tolerance)
+                return false;
+    return true;
+}
+
+// len outputs of the correlation of kh padded rows, starting at the output column, with the kw*kh weights f
+static void correlateRow(const float *const *rows, const float *f, int kw, int kh, int len, float *dst)
+{
+    memset(dst, 0, len*sizeof(float));
+    for (int n=0; n<kh; n++)
+    {
+        for (int m=0; m<kw; m++)
+        {
+            float k = f[n*kw+m];
+            if (k == 0)
+                continue;
+            const float *r = rows[n] + m;
+            for (int i=0; i<len; i++)
+                dst[i] += k*r[i];
+        }
+    }
+}
+
+static void convolveDirect(const float *padded, int pw, int w, int h, const float *f, int kw, int kh, float *dst)
+{
+#pragma omp parallel
+    {
+        QVarLengthArray<const float *, 32> rows(kh);
+#pragma omp for
+        for (int y=0; y<h; y++)
+        {
+            for (int n=0; n<kh; n++)
+                rows[n] = padded + (y+n)*pw;
+            correlateRow(rows.constData(), f, kw, kh, w, dst + y*w);
+        }
+    }
+}
+
+// row pass over all padded rows into tmp (w*(h+kh-1) values), then column pass
+static void convolveSeparable(const float *padded, int pw, int w, int h, const float *column, const float *row,
+                              int kw, int kh, float *tmp, float *dst)
+{
+    int ph = h+kh-1;
+#pragma omp parallel for
+    for (int r=0; r<ph; r++)
+    {
+        const float *p = padded + r*pw;
+        correlateRow(&p, row, kw, 1, w, tmp + r*w);
+    }
+
+#pragma omp parallel
+    {
+        QVarLengthArray<const float *, 32> rows(kh);
+#pragma omp for
+        for (int y=0; y<h; y++)
+        {
+            for (int n=0; n<kh; n++)
+                rows[n] = tmp + (y+n)*w;
+            correlateRow(rows.constData(), column, 1, kh, w, dst + y*w);
+        }
+    }
+}
+
+static int threadCount()
+{
+#ifdef _OPENMP
+    return qMax(omp_get_max_threads(), 1);
+#else
+    return 1;
+#endif
+}
+
+/*
+*Summary: how many FFT tiles can be in flight at once within the memory budget
+*Parameters:
+*    int nw, nh : transform size
+*    int tiles : number of tiles
+*    qint64 fixedBytes : scratch memory still to be borrowed besides the tiles
+*Return:
+*    at most one tile per thread, 0 if not even one tile fits next to the kernel spectrum
+*Describtion:
+*    Every thread transforms its tiles in a real block and a half spectrum, the kernel spectrum
+*    needs the same again once (see convolveFFT()).
+*/
+
+static int fftTileWorkers(int nw, int nh, int tiles, qint64 fixedBytes)
+{
+    qint64 tileBytes = nw*(qint64)nh*sizeof(float) + nh*(qint64)(nw/2+1)*sizeof(fftwf_complex);
+    int wanted = qMin(threadCount(), tiles);
+    return ScratchArena::fitUnits(tileBytes, wanted+1, fixedBytes) - 1;
+}
+
+static void multiplySpectrum(fftwf_complex *s, const fftwf_complex *k, int len)
+{
+    for (int i=0; i<len; i++)
+    {
+        float re = s[i][0]*k[i][0] - s[i][1]*k[i][1];
+        float im = s[i][0]*k[i][1] + s[i][1]*k[i][0];
+        s[i][0] = re;
+        s[i][1] = im;
+    }
+}
+
+/*
+*Summary: overlap-save convolution
+*Parameters:
+*    const float *padded : (w+kw-1)*(h+kh-1) values, see convolve2D()
+*    const float *kernel : kw*kh weights, not flipped
+*    int nw, nh : transform size, every tile gives (nw-kw+1)*(nh-kh+1) outputs
+*Describtion:
+*    Every tile of the padded plane is transformed, multiplied by the kernel spectrum and
+*    transformed back, the first kw-1 columns and kh-1 rows of the circular result wrap around
+*    and are dropped. Tiles are independent and run in parallel with the same two plans, on as
+*    many threads as the memory budget has room for tiles (see fftTileWorkers()).
+*/
+
+static void convolveFFT(const float *padded, int pw, int w, int h, const float *kernel, int kw, int kh,
+                        int nw, int nh, float *dst)
+{
+    int ph = h+kh-1;
+    int bw = nw-kw+1;
+    int bh = nh-kh+1;
+    int tiles_x = (w+bw-1) / bw;
+    int tiles_y = (h+bh-1) / bh;
+    int cw = nw/2+1;    // complex columns of the real transform
+    int workers = qMax(1, fftTileWorkers(nw, nh, tiles_x*tiles_y, 0));
+
+    ScratchScope scratch("convolveFFT");
+    float *in = scratch.alloc<float>(nw*nh);
+    fftwf_complex *kernelSpectrum = scratch.alloc<fftwf_complex>(nh*cw);
+    fftwf_plan forward, backward;
+    {
+        QMutexLocker locker(&fftwPlannerMutex());
+        forward = fftwf_plan_dft_r2c_2d(nh, nw, in, kernelSpectrum, FFTW_ESTIMATE);
+        backward = fftwf_plan_dft_c2r_2d(nh, nw, kernelSpectrum, in, FFTW_ESTIMATE);
+    }
+
+    // the kernel at the origin, scaled for the unnormalized inverse transform
+    memset(in, 0, nw*nh*sizeof(float));
+    for (int n=0; n<kh; n++)
+        for (int m=0; m<kw; m++)
+            in[n*nw+m] = kernel[n*kw+m] / (nw*nh);
+    fftwf_execute_dft_r2c(forward, in, kernelSpectrum);
+
+#pragma omp parallel num_threads(workers)
+    {
+        ScratchScope tileScratch;
+        float *tile = tileScratch.alloc<float>(nw*nh);
+        fftwf_complex *spectrum = tileScratch.alloc<fftwf_complex>(nh*cw);
+#pragma omp for
+        for (int t=0; t<tiles_x*tiles_y; t++)
+        {
+            int x0 = (t % tiles_x)*bw;
+            int y0 = (t / tiles_x)*bh;
+
+            // input block, zero outside the padded plane
+            int len = qMin(nw, pw-x0);
+            for (int n=0; n<nh; n++)
+            {
+                float *d = tile + n*nw;
+                int rowLen = y0+n < ph ? len : 0;
+                if (rowLen)
+                    memcpy(d, padded + (y0+n)*pw + x0, rowLen*sizeof(float));
+                memset(d + rowLen, 0, (nw-rowLen)*sizeof(float));
+            }
+
+            fftwf_execute_dft_r2c(forward, tile, spectrum);
+            multiplySpectrum(spectrum, kernelSpectrum, nh*cw);
+            fftwf_execute_dft_c2r(backward, spectrum, tile);
+
+            int ow = qMin(bw, w-x0);
+            int oh = qMin(bh, h-y0);
+            for (int n=0; n<oh; n++)
+                memcpy(dst + (y0+n)*w + x0, tile + (n+kh-1)*nw + kw-1, ow*sizeof(float));
+        }
+    }
+
+    QMutexLocker locker(&fftwPlannerMutex());
+    fftwf_destroy_plan(forward);
+    fftwf_destroy_plan(backward);
+}
+
+// nanoseconds per unit of work, single threaded
+struct ConvolutionCosts
+{
+    double multiplyAdd;     // one step of the direct and separable loops
+    double fft;             // one N*log2(N) of a real 2D transform of N samples
+    double pointwise;       // one spectrum element: product, tile copy and output copy
+    double plan;            // creating and destroying the two plans
+};
+
+static double elapsedPerUnit(QElapsedTimer &timer, double units)
+{
+    return timer.nsecsElapsed() / units;
+}
+
+// timings of the actual loops on small synthetic data, the best of three runs
+static ConvolutionCosts calibrate()
+{
+    ConvolutionCosts costs = {1e9, 1e9, 1e9, 1e9};
+    const int w = 128, h = 64, k = 9;
+    const int pw = w+k-1;
+    const int n = 256, cw = n/2+1;
+
+    ScratchScope scratch;
+    float *padded = scratch.alloc<float>(pw*(h+k-1));
+    float *out = scratch.alloc<float>(w*h);
+    float weights[k*k];
+    float *in = scratch.alloc<float>(n*n);
+    fftwf_complex *spectrum = scratch.alloc<fftwf_complex>(n*cw);
+    for (int i=0; i<pw*(h+k-1); i++)
+        padded[i] = (float)(i % 251);
+    for (int i=0; i<k*k; i++)
+        weights[i] = 1.0f / (1 + i);
+    for (int i=0; i<n*n; i++)
+        in[i] = (float)(i % 253);
+
+    for (int run=0; run<3; run++)
+    {
+        QElapsedTimer timer;
+        const float *rows[k];
+        timer.start();
+        for (int y=0; y<h; y++)
+        {
+            for (int r=0; r<k; r++)
+                rows[r] = padded + (y+r)*pw;
+            correlateRow(rows, weights, k, k, w, out + y*w);
+        }
+        costs.multiplyAdd = qMin(costs.multiplyAdd, elapsedPerUnit(timer, (double)w*h*k*k));
+
+        timer.start();
+        fftwf_plan forward, backward;
+        {
+            QMutexLocker locker(&fftwPlannerMutex());
+            forward = fftwf_plan_dft_r2c_2d(n, n, in, spectrum, FFTW_ESTIMATE);
+            backward = fftwf_plan_dft_c2r_2d(n, n, spectrum, in, FFTW_ESTIMATE);
+        }
+        costs.plan = qMin(costs.plan, (double)timer.nsecsElapsed());
+
+        timer.start();
+        fftwf_execute_dft_r2c(forward, in, spectrum);
+        costs.fft = qMin(costs.fft, elapsedPerUnit(timer, n*n*log2((double)n*n)));
+
+        timer.start();
+        multiplySpectrum(spectrum, spectrum, n*cw);
+        for (int y=0; y<n; y++)
+            memcpy(in + y*n, padded + (y % h)*pw, w*sizeof(float));
+        costs.pointwise = qMin(costs.pointwise, elapsedPerUnit(timer, (double)n*cw));
+
+        // the inverse transform restores finite values for the next run
+        for (int i=0; i<n*cw; i++)
+            spectrum[i][0] = spectrum[i][1] = 1;
+        fftwf_execute_dft_c2r(backward, spectrum, in);
+
+        QMutexLocker locker(&fftwPlannerMutex());
+        fftwf_destroy_plan(forward);
+        fftwf_destroy_plan(backward);
+    }
+    return costs;
+}
+
+static const ConvolutionCosts &convolutionCosts()
+{
+    static const ConvolutionCosts costs = calibrate();
+    return costs;
+}
+
+// fast transform lengths for one dimension, from twice the kernel to a single tile
+static QVector<int> fftLengths(int len, int k)
+{
+    QVector<int> lengths;
+    int last = optimalFFTSize(len+k-1);
+    for (int s=optimalFFTSize(qMin(2*k, last)); s<=last; s=optimalFFTSize(s+1))
+        lengths.append(s);
+    return lengths;
+}
+
+/*
+*Summary: pick the cheapest convolution method by the calibrated cost model
+*Parameters:
+*    bool separable : whether the kernel is rank one (see separateKernel())
+*    int *fftWidth, int *fftHeight : output transform size of the FFT tiles, if not null
+*Describtion:
+*    The loops are timed once per process on synthetic data. The direct and separable costs are
+*    their multiply-adds, the FFT cost is the kernel transform plus two transforms and one pointwise
+*    product per tile, minimized over all tile sizes of fast FFT lengths. The row loops spread over
+*    all threads, the tiles over at most as many threads as there are tiles and as the memory
+*    budget has room for. Tile sizes of which not even one fits into the budget are skipped.
+*/
+
+ConvolutionMethod chooseConvolution(int w, int h, int kw, int kh, bool separable, int *fftWidth, int *fftHeight)
+{
+    const ConvolutionCosts &costs = convolutionCosts();
+    int threads = threadCount();
+
+    ConvolutionMethod method = ConvolutionDirect;
+    double best = (double)w*h*kw*kh*costs.multiplyAdd / threads;
+    if (separable)
+    {
+        double cost = ((double)(h+kh-1)*w*kw + (double)w*h*kh)*costs.multiplyAdd / threads;
+        if (cost < best)
+        {
+            best = cost;
+            method = ConvolutionSeparable;
+        }
+    }
+
+    qint64 paddedBytes = (w+kw-1)*(qint64)(h+kh-1)*sizeof(float);
+    QVector<int> widths = fftLengths(w, kw);
+    QVector<int> heights = fftLengths(h, kh);
+    for (int nw : widths)
+    {
+        for (int nh : heights)
+        {
+            double samples = (double)nw*nh;
+            double transform = costs.fft*samples*log2(samples);
+            double perTile = 2*transform + costs.pointwise*nh*(nw/2+1);
+            int tiles = ((w+nw-kw)/(nw-kw+1)) * ((h+nh-kh)/(nh-kh+1));
+            int workers = fftTileWorkers(nw, nh, tiles, paddedBytes);
+            if (workers == 0)
+                continue;
+            double cost = costs.plan + transform + perTile*tiles / workers;
+            if (cost < best)
+            {
+                best = cost;
+                method = ConvolutionFFT;
+                if (fftWidth)
+                    *fftWidth = nw;
+                if (fftHeight)
+                    *fftHeight = nh;
+            }
+        }
+    }
+    return method;
+}
+
+/*
+*Summary: 2D convolution of float planes with any kernel
+*Parameters:
+*    const float *src : planes of w*h values
+*    int planes : number of planes
+*    const float *kernel : kh rows of kw weights, the anchor is (kw/2, kh/2)
+*    BorderType borderType : border extrapolation (zero for BORDER_CONSTANT)
+*    float *dst : output planes of w*h values
+*    ConvolutionMethod method : ConvolutionAuto picks by chooseConvolution(), ConvolutionSeparable
+*                               falls back to direct for kernels that are not rank one
+*Describtion:
+*    dst(x,y) = sum kernel(m,n) * src(x+kw/2-m, y+kh/2-n). Every plane is padded once and all
+*    methods read the padded plane, the direct and separable loops correlate it with the flipped
+*    kernel.
+*/
+
+void convolve2D(const float *src, int w, int h, int planes, const float *kernel, int kw, int kh,
+                BorderType borderType, float *dst, ConvolutionMethod method)
+{
+    int n = w*h;
+    int left = kw-1-kw/2;
+    int top = kh-1-kh/2;
+    int pw = w+kw-1;
+    int ph = h+kh-1;
+
+    ScratchScope scratch("convolve2D");
+    float *column = scratch.alloc<float>(kh);
+    float *row = scratch.alloc<float>(kw);
+    bool separable = separateKernel(kernel, kw, kh, column, row);
+
+    int nw = 0, nh = 0;
+    if (method == ConvolutionAuto)
+        method = chooseConvolution(w, h, kw, kh, separable, &nw, &nh);
+    if (method == ConvolutionSeparable && !separable)
+        method = ConvolutionDirect;
+    if (method == ConvolutionFFT && nw == 0)
+    {
+        // forced, one tile covers the whole plane
+        nw = optimalFFTSize(pw);
+        nh = optimalFFTSize(ph);
+    }
+
+    // flipped weights for the correlation loops
+    float *flipped = scratch.alloc<float>(kw*kh);
+    for (int i=0; i<kw*kh; i++)
+        flipped[i] = kernel[kw*kh-1-i];
+    float *flippedColumn = scratch.alloc<float>(kh);
+    float *flippedRow = scratch.alloc<float>(kw);
+    for (int i=0; i<kh; i++)
+        flippedColumn[i] = column[kh-1-i];
+    for (int i=0; i<kw; i++)
+        flippedRow[i] = row[kw-1-i];
+
+    float *padded = scratch.alloc<float>(pw*ph);
+    float *tmp = method == ConvolutionSeparable ? scratch.alloc<float>(w*ph) : nullptr;
+    for (int p=0; p<planes; p++)
+    {
+        copyMakeBorder(src + p*n, w, h, 1, top, ph-h-top, left, pw-w-left, borderType, (const float *)nullptr, padded);
+        switch (method) {
+        case ConvolutionSeparable:
+            convolveSeparable(padded, pw, w, h, flippedColumn, flippedRow, kw, kh, tmp, dst + p*n);
+            break;
+        case ConvolutionFFT:
+            convolveFFT(padded, pw, w, h, kernel, kw, kh, nw, nh, dst + p*n);
+            break;
+        default:
+            convolveDirect(padded, pw, w, h, flipped, kw, kh, dst + p*n);
+            break;
+        }
+    }
+}
+
+/*
+*Summary: convolution of an image, see convolve2D()
+*Return:
+*    Format_Grayscale8 / Format_RGB888 image with the results truncated to [0, 255],
+*    Format_Grayscale16 / Format_RGBX64 for 16 bit input (see concatenateImagePlanes())
+*/
+
+QImage convolveImage(const QImage &image, const float *kernel, int kw, int kh,
+                     BorderType borderType, ConvolutionMethod method)
+{
+    int w = image.width();
+    int h = image.height();
+    int cn = imageChannelCount(image);
+
+    QByteArray planes = ArtifactCache::instance().floatPlanes(image);
+    ScratchScope scratch("convolveImage");
+    float *filtered = scratch.alloc<float>(cn*w*h);
+    convolve2D((const float *)planes.constData(), w, h, cn, kernel, kw, kh, borderType, filtered, method);
+
+    QImage dst;
+    concatenateImagePlanes(filtered, w, h, cn, isHighBitDepth(image), dst);
+    return dst;
+}
@@ -0,0 +1,23 @@
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+
+#include <QImage>
+#include "padding.h"
+
+enum ConvolutionMethod {
+    ConvolutionAuto = 0,    // cheapest of the others by the cost model
+    ConvolutionDirect,      // O(kw*kh) per pixel
+    ConvolutionSeparable,   // O(kw+kh) per pixel, rank one kernels only
+    ConvolutionFFT,         // overlap-save with tiles of fast FFT lengths
+};
+
+int optimalFFTSize(int n);
+bool separateKernel(const float *kernel, int kw, int kh, float *column, float *row);
+ConvolutionMethod chooseConvolution(int w, int h, int kw, int kh, bool separable,
+                                    int *fftWidth = nullptr, int *fftHeight = nullptr);
+void convolve2D(const float *src, int w, int h, int planes, const float *kernel, int kw, int kh,
+                BorderType borderType, float *dst, ConvolutionMethod method = ConvolutionAuto);
+QImage convolveImage(const QImage &image, const float *kernel, int kw, int kh,
+                     BorderType borderType, ConvolutionMethod method = ConvolutionAuto);
+
+#endif // CONVOLUTION_H
@@ -80,6 +80,12 @@ void DilateDialog::Dilation(QImage &src_image, QImage &dst_image)
         { 0,1,1,1,1,1,0 },
         { 0,0,0,1,0,0,0 } };
     int sizeKernel = 7;
+    // gray image: single channel dilation, Format_Grayscale8 result
+    if (imageChannelCount(src_image) == 1)
+    {
+        grayMorphology(src_image, &kernel[0][0], sizeKernel, true, dst_image);
+        return;
+    }
     QColor color;
     QColor Rcolor;
 
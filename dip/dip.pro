@@ -1,4 +1,4 @@
-QT += widgets
+QT += widgets concurrent
 requires(qtConfig(filedialog))
 qtHaveModule(printsupport): QT += printsupport
 QMAKE_CXXFLAGS+= -openmp
@@ -18,7 +18,21 @@ HEADERS       = mainwindow.h \
     dilatedialog.h \
     opendialog.h \
     closedialog.h \
-    thresholddialog.h
+    thresholddialog.h \
+    imagehistory.h \
+    tiledimageitem.h \
+    artifactcache.h \
+    clahedialog.h \
+    labeling.h \
+    labeldialog.h \
+    gaussian.h \
+    gaussianblurdialog.h \
+    median.h \
+    medianfilterdialog.h \
+    bilateral.h \
+    edgedetect.h \
+    scratcharena.h \
+    convolution.h
 SOURCES       = main.cpp \
                 acedialog.cpp \
                 embossfilterdialog.cpp \
@@ -33,7 +47,21 @@ SOURCES       = main.cpp \
     dilatedialog.cpp \
     opendialog.cpp \
     closedialog.cpp \
-    thresholddialog.cpp
+    thresholddialog.cpp \
+    imagehistory.cpp \
+    tiledimageitem.cpp \
+    artifactcache.cpp \
+    clahedialog.cpp \
+    labeling.cpp \
+    labeldialog.cpp \
+    gaussian.cpp \
+    gaussianblurdialog.cpp \
+    median.cpp \
+    medianfilterdialog.cpp \
+    bilateral.cpp \
+    edgedetect.cpp \
+    scratcharena.cpp \
+    convolution.cpp
 RESOURCES     = \
     dip.qrc \
     qss.qrc
@@ -0,0 +1,344 @@
+#include "edgedetect.h"
+#include "imageprocess.h"
+#include "artifactcache.h"
+#include "gaussian.h"
+#include "scratcharena.h"
+#include <QVector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// edge map states
+enum { NoEdge = 0, WeakEdge = 1, StrongEdge = 2 };
+
+/*
+*Summary: sobel gradients and L1 magnitude of one row, the border is replicated
+*Parameters:
+*    const uchar *up, *row, *down : gray rows y-1, y and y+1
+*    int width : row length
+*    short *dx, *dy : output gradients, |dx|, |dy| <= 1020
+*    int *mag : output |dx| + |dy|, mag[-1] and mag[width] are 0
+*/
+
+static void sobelRow(const uchar *up, const uchar *row, const uchar *down, int width,
+                     short *dx, short *dy, int *mag)
+{
+    mag[-1] = mag[width] = 0;
+    for (int i=0; i<width; i++)
+    {
+        int l = i > 0 ? i-1 : 0;
+        int r = i < width-1 ? i+1 : width-1;
+        short gx = (short)((up[r] + 2*row[r] + down[r]) - (up[l] + 2*row[l] + down[l]));
+        short gy = (short)((down[l] + 2*down[i] + down[r]) - (up[l] + 2*up[i] + up[r]));
+        dx[i] = gx;
+        dy[i] = gy;
+        mag[i] = (gx < 0 ? -gx : gx) + (gy < 0 ? -gy : gy);
+    }
+}
+
+/*
+*Summary: canny edge detector
+*Parameters:
+*    const QImage &image : input image, the luma is used
+*    float sigma : standard deviation of the gaussian smoothing, 0 for none
+*    int low_threshold : weak edge threshold on the L1 gradient magnitude |dx| + |dy|
+*    int high_threshold : strong edge threshold
+*Return:
+*    Format_Grayscale8 image, 255 on edges and 0 elsewhere
+*Describtion:
+*    (1) The rows are split into one band per thread. A band streams over its rows with a ring of
+*        three gradient rows (one row of halo above and below the band): the sobel gradient of the
+*        next row is computed, then the middle row is non-maximum suppressed along the quantized
+*        gradient direction (0, 45, 90 or 135 degree, decided with integer tangent comparisons)
+*        and classified as weak or strong. Only the edge map is full size.
+*    (2) Hysteresis: every band grows its strong edges into connected weak pixels with a stack,
+*        restricted to its own rows. Growth that crosses a band border is collected and finished
+*        by a sequential propagation afterwards.
+*/
+
+QImage cannyEdgeDetect(const QImage &image, float sigma, int low_threshold, int high_threshold)
+{
+    QImage gray = ArtifactCache::instance().grayImage(image);
+    if (sigma > 0)
+        gray = gaussianBlur(gray, sigma);
+    int width = gray.width();
+    int height = gray.height();
+    if (high_threshold < low_threshold)
+        qSwap(low_threshold, high_threshold);
+
+    QImage newImage(width, height, QImage::Format_Grayscale8);
+    if (width == 0 || height == 0)
+        return newImage;
+
+    int bands = 1;
+#ifdef _OPENMP
+    bands = qBound(1, omp_get_max_threads(), height);
+#endif
+    int band_rows = (height + bands - 1) / bands;
+    QVector<QVector<int> > crossing(bands);   // pixels just outside a band that its edges reach
+
+    // tan(22.5) and tan(67.5) in 15 bit fixed point
+    const int tg22 = (int)(0.4142135623730950488016887242097 * (1 << 15) + 0.5);
+
+#pragma omp parallel for
+    for (int band=0; band<bands; band++)
+    {
+        int y0 = band*band_rows;
+        int y1 = qMin(y0 + band_rows, height);
+        if (y0 >= y1)
+            continue;
+
+        // ring of three gradient rows, the magnitudes have one zero cell on both sides
+        ScratchScope bandScratch;
+        short *dx = bandScratch.alloc<short>(3*width);
+        short *dy = bandScratch.alloc<short>(3*width);
+        int *mag_buffer = bandScratch.alloc<int>(3*(width+2));
+        int *mag[3] = {mag_buffer+1, mag_buffer+width+3, mag_buffer+2*width+5};
+
+        // rows y0-1 and y0 (zero magnitude above the image)
+        for (int k=0; k<2; k++)
+        {
+            int y = y0 - 1 + k;
+            if (y < 0)
+            {
+                memset(mag[k]-1, 0, (width+2)*sizeof(int));
+                continue;
+            }
+            sobelRow(gray.constScanLine(qMax(y-1, 0)), gray.constScanLine(y),
+                     gray.constScanLine(qMin(y+1, height-1)), width, dx+k*width, dy+k*width, mag[k]);
+        }
+
+        int prev = 0, cur = 1, next = 2;
+        for (int y=y0; y<y1; y++)
+        {
+            // gradient of row y+1, then suppress row y
+            if (y+1 < height)
+                sobelRow(gray.constScanLine(y), gray.constScanLine(y+1),
+                         gray.constScanLine(qMin(y+2, height-1)), width, dx+next*width, dy+next*width, mag[next]);
+            else
+                memset(mag[next]-1, 0, (width+2)*sizeof(int));
+
+            const short *gx = dx + cur*width;
+            const short *gy = dy + cur*width;
+            const int *m_prev = mag[prev];
+            const int *m_cur = mag[cur];
+            const int *m_next = mag[next];
+            uchar *map = newImage.scanLine(y);
+            for (int i=0; i<width; i++)
+            {
+                int m = m_cur[i];
+                map[i] = NoEdge;
+                if (m <= low_threshold)
+                    continue;
+
+                int xs = gx[i];
+                int ys = gy[i];
+                int x = xs < 0 ? -xs : xs;
+                int yv = (ys < 0 ? -ys : ys) << 15;
+                int tg22x = x * tg22;
+                bool maximum;
+                if (yv < tg22x)                         // horizontal gradient
+                {
+                    maximum = m > m_cur[i-1] && m >= m_cur[i+1];
+                }
+                else if (yv > tg22x + (x << 16))        // vertical gradient, tan(67.5) = tan(22.5) + 2
+                {
+                    maximum = m > m_prev[i] && m >= m_next[i];
+                }
+                else                                    // diagonal gradient
+                {
+                    int s = (xs ^ ys) < 0 ? -1 : 1;
+                    int l = i - s, r = i + s;
+                    int ml = (l >= 0 && l < width) ? m_prev[l] : 0;
+                    int mr = (r >= 0 && r < width) ? m_next[r] : 0;
+                    maximum = m > ml && m > mr;
+                }
+                if (maximum)
+                    map[i] = m > high_threshold ? StrongEdge : WeakEdge;
+            }
+
+            int t = prev; prev = cur; cur = next; next = t;
+        }
+    }
+
+    // (2) hysteresis inside the bands, the band maps are final after the loop above
+#pragma omp parallel for
+    for (int band=0; band<bands; band++)
+    {
+        int y0 = band*band_rows;
+        int y1 = qMin(y0 + band_rows, height);
+        QVector<int> stack;
+        for (int y=y0; y<y1; y++)
+        {
+            const uchar *map = newImage.constScanLine(y);
+            for (int i=0; i<width; i++)
+                if (map[i] == StrongEdge)
+                    stack.append(y*width+i);
+        }
+        while (!stack.isEmpty())
+        {
+            int p = stack.takeLast();
+            int py = p / width, px = p % width;
+            for (int ny=py-1; ny<=py+1; ny++)
+            {
+                if (ny < 0 || ny >= height)
+                    continue;
+                for (int nx=qMax(px-1, 0); nx<=qMin(px+1, width-1); nx++)
+                {
+                    if (ny < y0 || ny >= y1)
+                    {
+                        crossing[band].append(ny*width+nx);     // decided after all bands are done
+                        continue;
+                    }
+                    uchar *q = newImage.scanLine(ny) + nx;
+                    if (*q == WeakEdge)
+                    {
+                        *q = StrongEdge;
+                        stack.append(ny*width+nx);
+                    }
+                }
+            }
+        }
+    }
+
+    // growth across the band borders
+    QVector<int> stack;
+    for (int band=0; band<bands; band++)
+        stack += crossing[band];
+    while (!stack.isEmpty())
+    {
+        int p = stack.takeLast();
+        uchar *q = newImage.scanLine(p / width) + p % width;
+        if (*q != WeakEdge)
+            continue;
+        *q = StrongEdge;
+        int py = p / width, px = p % width;
+        for (int ny=qMax(py-1, 0); ny<=qMin(py+1, height-1); ny++)
+            for (int nx=qMax(px-1, 0); nx<=qMin(px+1, width-1); nx++)
+                if (newImage.constScanLine(ny)[nx] == WeakEdge)
+                    stack.append(ny*width+nx);
+    }
+
+    // edge map --> image
+#pragma omp parallel for
+    for (int y=0; y<height; y++)
+    {
+        uchar *map = newImage.scanLine(y);
+        for (int i=0; i<width; i++)
+            map[i] = map[i] == StrongEdge ? 255 : 0;
+    }
+
+    return newImage;
+}
+
+// Gx and Gy of len values, a, b and c point to the first center pixel in the rows y-1, y and y+1
+static void gradientRow(const uchar *a, const uchar *b, const uchar *c, int cn, GradientOperator op,
+                        int len, short *gx, short *gy)
+{
+    switch (op)
+    {
+    case GradientRoberts:
+        for (int i=0; i<len; i++)
+        {
+            gx[i] = (short)(b[i] - c[i+cn]);
+            gy[i] = (short)(b[i+cn] - c[i]);
+        }
+        break;
+    case GradientSobel:
+        for (int i=0; i<len; i++)
+        {
+            gx[i] = (short)((c[i-cn] + 2*c[i] + c[i+cn]) - (a[i-cn] + 2*a[i] + a[i+cn]));
+            gy[i] = (short)((a[i+cn] + 2*b[i+cn] + c[i+cn]) - (a[i-cn] + 2*b[i-cn] + c[i-cn]));
+        }
+        break;
+    case GradientPrewitt:
+        for (int i=0; i<len; i++)
+        {
+            gx[i] = (short)((c[i-cn] + c[i] + c[i+cn]) - (a[i-cn] + a[i] + a[i+cn]));
+            gy[i] = (short)((a[i+cn] + b[i+cn] + c[i+cn]) - (a[i-cn] + b[i-cn] + c[i-cn]));
+        }
+        break;
+    }
+}
+
+/*
+*Summary: gradient magnitude of a 3x3 gradient operator in a single pass
+*Parameters:
+*    const uchar *src : w*h*cn interleaved values
+*    int w : image width
+*    int h : image height
+*    int cn : channel count
+*    GradientOperator op : Roberts (2x2), Sobel or Prewitt
+*    bool l2 : sqrt(gx^2 + gy^2) instead of |gx| + |gy|
+*    BorderType borderType : border extrapolation, see copyMakeBorder() (zero for BORDER_CONSTANT)
+*    uchar *dst : output w*h*cn magnitudes clamped to 255
+*    float *direction : optional output w*h*cn gradient directions atan2(gy, gx) in radians
+*Describtion:
+*    Both derivatives are computed from one read of each neighbourhood, with signed 16 bit sums
+*    (|g| <= 1020 for Sobel), so negative gradients count as much as positive ones. The operator is
+*    chosen once per row, the inner loops are plain 16 bit arithmetic the compiler vectorizes.
+*    The border is virtual: rows come from a row table and only the first and last pixel of a row
+*    are resolved through the column table, no padded copy of the image is made.
+*    Rows are processed in parallel.
+*/
+
+void gradientFilter(const uchar *src, int w, int h, int cn, GradientOperator op, bool l2,
+                    BorderType borderType, uchar *dst, float *direction)
+{
+    int row_len = w*cn;
+    ScratchScope scratch;
+    const uchar **rows = scratch.alloc<const uchar *>(h+2);
+    int *tab = scratch.alloc<int>(w+2);
+    uchar *zeros = scratch.alloc<uchar>(row_len);
+    memset(zeros, 0, row_len);
+    borderRows(src, w, h, cn, 1, borderType, zeros, rows);
+    borderTable(w, 1, borderType, tab);
+
+#pragma omp parallel
+    {
+        ScratchScope rowScratch;
+        short *gx = rowScratch.alloc<short>(row_len);
+        short *gy = rowScratch.alloc<short>(row_len);
+        uchar patch[27];
+#pragma omp for
+        for (int j=0; j<h; j++)
+        {
+            const uchar *a = rows[j];               // row above
+            const uchar *b = rows[j+1];             // center row
+            const uchar *c = rows[j+2];             // row below
+
+            // interior without any border test, then the two border pixels
+            if (w > 2)
+                gradientRow(a+cn, b+cn, c+cn, cn, op, (w-2)*cn, gx+cn, gy+cn);
+            for (int x=0; x<w; x+=qMax(w-1, 1))
+            {
+                gatherBorderPatch(rows+j, 1, tab, 1, x, cn, patch);
+                gradientRow(patch+cn, patch+4*cn, patch+7*cn, cn, op, cn, gx+x*cn, gy+x*cn);
+            }
+
+            uchar *d = dst + j*row_len;
+            if (l2)
+            {
+                for (int k=0; k<row_len; k++)
+                {
+                    float m = sqrtf((float)(gx[k]*gx[k] + gy[k]*gy[k]));
+                    d[k] = (uchar)(m > 255 ? 255 : m);
+                }
+            }
+            else
+            {
+                for (int k=0; k<row_len; k++)
+                {
+                    int m = (gx[k] < 0 ? -gx[k] : gx[k]) + (gy[k] < 0 ? -gy[k] : gy[k]);
+                    d[k] = (uchar)(m > 255 ? 255 : m);
+                }
+            }
+            if (direction)
+            {
+                float *dir = direction + j*row_len;
+                for (int k=0; k<row_len; k++)
+                    dir[k] = atan2f(gy[k], gx[k]);
+            }
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef EDGEDETECT_H
+#define EDGEDETECT_H
+
+#include <QImage>
+#include "padding.h"
+
+enum GradientOperator
+{
+    GradientRoberts = 0,
+    GradientSobel,
+    GradientPrewitt
+};
+
+void gradientFilter(const uchar *src, int w, int h, int cn, GradientOperator op, bool l2,
+                    BorderType borderType, uchar *dst, float *direction = nullptr);
+QImage cannyEdgeDetect(const QImage &image, float sigma, int low_threshold, int high_threshold);
+
+#endif // EDGEDETECT_H
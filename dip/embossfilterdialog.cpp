@@ -1,102 +1,75 @@
 #include "embossfilterdialog.h"
 
-// 8 kinds of image emboss filter masks
-float emboss[8][9]=
+// eight emboss directions of len values, a and c point to the first center pixel in the rows y-1 and y+1
+static void embossRow(const uchar *a, const uchar *c, int cn, int len, uchar *const *dst, int offset)
 {
+    for (int i=0; i<len; i++)
     {
-        -1, 0, 0,
-         0, 0, 0,
-         0, 0, 1
-    },
-    {
-         1, 0, 0,
-         0, 0, 0,
-         0, 0, -1
-    },
-    {
-         0, 0, -1,
-         0, 0, 0,
-         1, 0, 0
-    },
-    {
-         0, 0, 1,
-         0, 0, 0,
-        -1, 0, 0
-    },
-    {
-        -1, 0, -1,
-         0, 0,  0,
-         1, 0,  1
-    },
-    {
-        -1, 0, 1,
-         0, 0, 0,
-         1, 0, -1
-    },
-    {
-        1, 0, 1,
-        0, 0, 0,
-       -1, 0, -1
-    },
-    {
-        1, 0, -1,
-        0, 0, 0,
-       -1, 0, 1
+        int p00 = a[i-cn];
+        int p02 = a[i+cn];
+        int p20 = c[i-cn];
+        int p22 = c[i+cn];
+        int val[8];
+        val[0] = p00 - p22;
+        val[2] = p02 - p20;
+        val[4] = p00 + p02 - p20 - p22;
+        val[5] = p02 + p20 - p00 - p22;
+        val[1] = -val[0];
+        val[3] = -val[2];
+        val[6] = -val[4];
+        val[7] = -val[5];
+        for (int k=0; k<8; k++)
+        {
+            if (dst[k])
+                dst[k][offset+i] = (uchar)qBound(0, val[k], 255);
+        }
     }
-};
+}
 
 /*
-*Summary : image emboss filter process
+*Summary : all eight emboss filters in one pass
 *
 *Parameters:
-*    const uchar *src : input original image
-*    int w :
-*    int h :
-*    const float *kernel :
-*    int hkw :
-*    int hkh :
-*    uchar *dst :
+*    const uchar *src : input image, not padded
+*    int w : image width
+*    int h : image height
+*    int cn : channel count, 1 for a gray plane, 3 for interleaved rgb
+*    BorderType borderType : border extrapolation (zero for BORDER_CONSTANT)
+*    uchar *dst[8] : w*h*cn outputs in EmbossFilterType order, a null entry is skipped
+*Describtion:
+*    The eight emboss masks only use the four corners of the 3x3 neighbourhood, p00 top-left,
+*    p02 top-right, p20 bottom-left and p22 bottom-right, with weights of +-1:
+*        Emboss1 = p00-p22          Emboss2 = -Emboss1
+*        Emboss3 = p02-p20          Emboss4 = -Emboss3
+*        Emboss5 = p00+p02-p20-p22  Emboss7 = -Emboss5
+*        Emboss6 = p02+p20-p00-p22  Emboss8 = -Emboss6
+*    so each neighbourhood is loaded once, four sums are formed in integers and the
+*    eight results are clamped to [0, 255]. The border is virtual, rows come from a row table
+*    and only the first and last pixel of a row go through the column table.
+*    The rows are filtered in parallel.
 */
-static void filterProc(const uchar *src, int w, int h,
-            const float *kernel, int hkw, int hkh, uchar *dst)
+static void embossProc(const uchar *src, int w, int h, int cn, BorderType borderType, uchar *dst[8])
 {
-    int i, j, m, n;
-    float val_r, val_g, val_b, r, g, b;
-    int nw = w-2*hkw;
-    int nh = h-2*hkh;
-    int kw = 2*hkw+1;
-    int kh = 2*hkh+1;
-
-    memset(dst, 0, nw*nh*3);
-
-    for (j=hkh; j<h-hkh; j++)
+    int len = w*cn;
+    ScratchScope scratch;
+    const uchar **rows = scratch.alloc<const uchar *>(h+2);
+    int *tab = scratch.alloc<int>(w+2);
+    uchar *zeros = scratch.alloc<uchar>(len);
+    memset(zeros, 0, len);
+    borderRows(src, w, h, cn, 1, borderType, zeros, rows);
+    borderTable(w, 1, borderType, tab);
+
+#pragma omp parallel for
+    for (int j=0; j<h; j++)
     {
-        for (i=hkw; i<w-hkw; i++)
+        uchar patch[27];
+        int offset = j*len;
+        if (w > 2)
+            embossRow(rows[j]+cn, rows[j+2]+cn, cn, (w-2)*cn, dst, offset+cn);
+        for (int x=0; x<w; x+=qMax(w-1, 1))
         {
-            val_r = val_g  = val_b = 0;
-            for (n=-hkh; n<=hkh; n++)
-            {
-                for (m=-hkw; m<=hkw; m++)
-                {
-                    r = src[(j-n)*w*3+(i-m)*3];
-                    g = src[(j-n)*w*3+(i-m)*3+1];
-                    b = src[(j-n)*w*3+(i-m)*3+2];
-                    val_r +=  r * kernel[(n+hkh)*kw+m+hkw];
-                    val_g +=  g * kernel[(n+hkh)*kw+m+hkw];
-                    val_b +=  b * kernel[(n+hkh)*kw+m+hkw];
-                }
-            }
-            val_r = val_r>255 ? 255 : val_r;
-            val_g = val_g>255 ? 255 : val_g;
-            val_b = val_b>255 ? 255 : val_b;
-
-            val_r = val_r<0 ? 0 : val_r;
-            val_g = val_g<0 ? 0 : val_g;
-            val_b = val_b<0 ? 0 : val_b;
-
-            dst[(j-hkh)*nw*3+(i-hkw)*3] = (uchar)(val_r);
-            dst[(j-hkh)*nw*3+(i-hkw)*3+1] = (uchar)(val_g);
-            dst[(j-hkh)*nw*3+(i-hkw)*3+2] = (uchar)(val_b);
+            gatherBorderPatch(rows+j, 1, tab, 1, x, cn, patch);
+            embossRow(patch+cn, patch+7*cn, cn, cn, dst, offset+x*cn);
         }
     }
 }
@@ -109,7 +82,8 @@ EmbossFilterDialog::EmbossFilterDialog(QImage inputImage)
     int h = emboss1Image.height();
     int pixel_num = w*h;
 
-    rgb = new uchar[3*pixel_num];
+    cn = imageChannelCount(emboss1Image);   // gray images are filtered as one plane
+    rgb = dialogScratch.alloc<uchar>(cn*pixel_num);
     borderType = 0;
     halfKernelSize = 1;
     sigma = 2;
@@ -118,35 +92,22 @@ EmbossFilterDialog::EmbossFilterDialog(QImage inputImage)
     iniUI();
 
     // obtain image channels
-    splitImageChannel(emboss1Image, rgb);
+    splitImageChannel(emboss1Image, rgb, cn);
 
     //int count = borderTypeComboBox->count();
     //borderTypeComboBox->setCurrentIndex(count-1);
 
-    // padding
-    int hkw = 1;
-    int hkh = 1;
-    int nw = w+hkw*2;
-    int nh = h+hkh*2;
-    rgbPadded = new uchar[3*nw*nh];
-    paddedImage = QImage(nw, nh, QImage::Format_RGB888);
-    uchar constBorder[3] = {0};
-    copyMakeBorder(rgb, w, h, 3,
-                   halfKernelSize, halfKernelSize, halfKernelSize, halfKernelSize, (BorderType)borderType,
-                   constBorder, rgbPadded);
-    //concatenateImageChannel(rgbPadded, nw, nh, paddedImage);
-
-    //paddedImageLabel->setPixmap(QPixmap::fromImage(paddedImage));
+    // the eight directions from one sweep over the image
+    ScratchScope scratch("embossFilter");
+    uchar *filtered[8];
+    for (int k=0; k<8; k++)
+        filtered[k] = scratch.alloc<uchar>(cn*pixel_num);
+    embossProc(rgb, w, h, cn, (BorderType)borderType, filtered);
 
-    emboss1Image = imageFilter((int)EmbossFilterType::Emboss1);
-    emboss2Image = imageFilter((int)EmbossFilterType::Emboss2);
-    emboss3Image = imageFilter((int)EmbossFilterType::Emboss3);
-    emboss4Image = imageFilter((int)EmbossFilterType::Emboss4);
-
-    emboss5Image = imageFilter((int)EmbossFilterType::Emboss5);
-    emboss6Image = imageFilter((int)EmbossFilterType::Emboss6);
-    emboss7Image = imageFilter((int)EmbossFilterType::Emboss7);
-    emboss8Image = imageFilter((int)EmbossFilterType::Emboss8);
+    QImage *embossImages[8] = {&emboss1Image, &emboss2Image, &emboss3Image, &emboss4Image,
+                               &emboss5Image, &emboss6Image, &emboss7Image, &emboss8Image};
+    for (int k=0; k<8; k++)
+        concatenateImageChannel(filtered[k], w, h, cn, *embossImages[k]);
 
     emboss1ImageLabel->setPixmap(QPixmap::fromImage(emboss1Image).scaled(emboss1ImageLabel->width(), emboss1ImageLabel->height()));
     emboss2ImageLabel->setPixmap(QPixmap::fromImage(emboss2Image).scaled(emboss2ImageLabel->width(), emboss2ImageLabel->height()));
@@ -157,33 +118,23 @@ EmbossFilterDialog::EmbossFilterDialog(QImage inputImage)
     emboss6ImageLabel->setPixmap(QPixmap::fromImage(emboss6Image).scaled(emboss6ImageLabel->width(), emboss6ImageLabel->height()));
     emboss7ImageLabel->setPixmap(QPixmap::fromImage(emboss7Image).scaled(emboss7ImageLabel->width(), emboss7ImageLabel->height()));
     emboss8ImageLabel->setPixmap(QPixmap::fromImage(emboss8Image).scaled(emboss8ImageLabel->width(), emboss8ImageLabel->height()));
-
-    delete [] rgbPadded;
-    rgbPadded = nullptr;
 }
 
 QImage EmbossFilterDialog::imageFilter(int inputFilterType)
 {
     int w = emboss1Image.width();
     int h = emboss1Image.height();
-    int hkw = 1;
-    int hkh = 1;
-
-    float *filterKernelX;// = new float[(2*hkw+1)*(2*hkh+1)];
-
-    filterKernelX = emboss[(int)inputFilterType];
-
-    int nw = w+hkw*2;
-    int nh = h+hkh*2;
-    rgbFilteredX = new uchar[3*w*h];
+    ScratchScope scratch("embossFilter");
+    rgbFilteredX = scratch.alloc<uchar>(cn*w*h);
 
-    // filtering
-    filterProc(rgbPadded, nw, nh, filterKernelX, hkw, hkh, rgbFilteredX);
+    // filtering, only the requested direction is written
+    uchar *filtered[8] = {nullptr};
+    filtered[inputFilterType] = rgbFilteredX;
+    embossProc(rgb, w, h, cn, (BorderType)borderType, filtered);
 
     QImage dst;
-    concatenateImageChannel(rgbFilteredX, w, h, dst);
+    concatenateImageChannel(rgbFilteredX, w, h, cn, dst);
 
-    delete [] rgbFilteredX;
     rgbFilteredX = nullptr;
 
     return dst;
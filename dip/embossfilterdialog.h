@@ -17,6 +17,7 @@
 #include "imageprocess.h"
 #include "padding.h"
 #include "floatslider.h"
+#include "scratcharena.h"
 #include <QApplication>
 #include <QDesktopWidget>
 
@@ -57,12 +58,6 @@ public:
     EmbossFilterDialog(QImage inputImage);
     ~EmbossFilterDialog()
     {
-        if (rgb)
-            delete [] rgb;
-        if (rgbPadded)
-            delete [] rgbPadded;
-        if (rgbFilteredX)
-            delete [] rgbFilteredX;
         if (filterKernelX)
             delete [] filterKernelX;
     }
@@ -84,8 +79,9 @@ private:
     QImage paddedImage;
     QImage dstImage;
 
+    int cn = 3;
+    ScratchScope dialogScratch;     // buffers that live as long as the dialog
     uchar *rgb = nullptr;
-    uchar *rgbPadded = nullptr;
     uchar *rgbFilteredX = nullptr;
     uchar *rgbFilteredY = nullptr;
     float *filterKernelX = nullptr;
@@ -78,6 +78,12 @@ void ErodeDialog::Erosion(QImage &src_image, QImage &dst_image)
         { 0,1,1,1,0 },
         { 0,0,1,0,0 } };
     int sizeKernel = 5;
+    // gray image: single channel erosion, Format_Grayscale8 result
+    if (imageChannelCount(src_image) == 1)
+    {
+        grayMorphology(src_image, &kernel[0][0], sizeKernel, false, dst_image);
+        return;
+    }
     QColor color;
     QColor Rcolor;
 
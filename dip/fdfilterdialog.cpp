@@ -1,4 +1,5 @@
 #include "fdfilterdialog.h"
+#include "artifactcache.h"
 
 FDFilterDialog::FDFilterDialog(QImage inputImage)
 {
@@ -6,34 +7,24 @@ FDFilterDialog::FDFilterDialog(QImage inputImage)
 
     int image_width = srcImage.width();
     int image_height = srcImage.height();
-    int pixel_num = image_width*image_height;
 
-    rgb = new float[3*pixel_num];
-    filter = new float[3*pixel_num];
+    // the spectrum is computed at FFTW friendly sizes, the filtered image is cropped back
+    fftPaddedSize(image_width, image_height, fftWidth, fftHeight);
+
+    cn = imageChannelCount(srcImage);   // gray images are filtered as one plane
+    filter = dialogScratch.alloc<float>(fftWidth*fftHeight);     // one transfer function for all planes
     filterType = 0;
     filterSize = 3;
     maxFilterSize = std::min(image_width, image_height) / 2;
-    spectrum = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * 3*pixel_num);
-    shiftedSpectrum = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * 3*pixel_num);
-
-    // obtain image channels
-    splitImageChannel(srcImage, rgb, rgb+pixel_num, rgb+2*pixel_num);
-
-    // original spectrum
-    fftw2d(rgb, image_width, image_height, spectrum);
-
-    // fftshift
-    fftshift2D(spectrum, image_width, image_height, shiftedSpectrum);
 
-    // spectrum QImage
-    spectrum2QImage(shiftedSpectrum, image_width, image_height, spectrumImage);
+    // shifted spectrum and its QImage, shared with the spectrum view of the same image
+    loadSpectrum();
 
     // generate filter
-    generateFilter(image_width, image_height, filterSize, (ImageFilterType)filterType, filter);
+    generateFilter(fftWidth, fftHeight, filterSize, (ImageFilterType)filterType, filter);
 
     // filtering
-    imageFilterFFT2D(shiftedSpectrum, image_width, image_height, filter,
-                          filteredSpectrumImage, dstImage);
+    filterImage();
 
     iniUI();
 
@@ -65,6 +56,14 @@ void FDFilterDialog::iniUI()
     filterTypeComboBox->addItem(tr("Butterworth low pass"));
     filterTypeComboBox->addItem(tr("Butterworth high pass"));
 
+    // channels, luma only filters Y and keeps the chroma of color images
+    channelsLabel = new QLabel(tr("Channels"));
+    channelsLabel->setAlignment(Qt::AlignRight);
+    channelsComboBox = new QComboBox;
+    channelsComboBox->addItem(tr("RGB"));
+    channelsComboBox->addItem(tr("Luma only"));
+    channelsComboBox->setEnabled(cn == 3);
+
     // filter size
     filterSizeLabel = new QLabel(tr("Filter Size"));
     filterSizeSlider = new FloatSlider(Qt::Horizontal);
@@ -80,6 +79,7 @@ void FDFilterDialog::iniUI()
     // signal slot
     connect(filterSizeSlider, SIGNAL(valueChanged(int)), this, SLOT(updateDstImage(int)));
     connect(filterTypeComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(updateDstImage(int)));
+    connect(channelsComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(updateDstImage(int)));
 
     // three buttons
     btnOK = new QPushButton(tr("OK"));
@@ -103,6 +103,9 @@ void FDFilterDialog::iniUI()
     layout3->addWidget(filterTypeLabel, 3);
     layout3->addWidget(filterTypeComboBox, 5);
     layout3->addStretch();
+    layout3->addWidget(channelsLabel, 3);
+    layout3->addWidget(channelsComboBox, 5);
+    layout3->addStretch();
     layout3->addWidget(filterSizeLabel, 3);
     layout3->addWidget(filterSizeSlider, 5);
     layout3->addWidget(filterSizeEdit, 3);
@@ -124,6 +127,25 @@ void FDFilterDialog::iniUI()
     setLayout(mainlayout);
 }
 
+// the spectrum of all planes, or of the luma plane only, from the artifact cache
+void FDFilterDialog::loadSpectrum()
+{
+    shiftedSpectrum = ArtifactCache::instance().shiftedSpectrum(srcImage, lumaOnly);
+    spectrumImage = ArtifactCache::instance().spectrumImage(srcImage, lumaOnly);
+    lumaChroma = lumaOnly ? ArtifactCache::instance().lumaChromaPlanes(srcImage) : QByteArray();
+}
+
+void FDFilterDialog::filterImage()
+{
+    const fftwf_complex *spectrum = (const fftwf_complex *)shiftedSpectrum.constData();
+    if (lumaOnly)
+        imageFilterLumaFFT2D(spectrum, fftWidth, fftHeight, (const float *)lumaChroma.constData(), filter,
+                             filteredSpectrumImage, dstImage, isHighBitDepth(srcImage), srcImage.size());
+    else
+        imageFilterFFT2D(spectrum, fftWidth, fftHeight, cn, filter,
+                         filteredSpectrumImage, dstImage, isHighBitDepth(srcImage), srcImage.size());
+}
+
 void FDFilterDialog::setImage(QImage image, QLabel *label)
 {
     QPixmap pix;
@@ -142,12 +164,17 @@ void FDFilterDialog::updateDstImage(int value)
     {
         filterType = value;
     }
+    else if (QObject::sender() == channelsComboBox)
+    {
+        lumaOnly = value == 1;
+        loadSpectrum();
+        spectrumImageLabel->setPixmap(QPixmap::fromImage(spectrumImage));
+    }
 
     // generate filter
-    generateFilter(srcImage.width(), srcImage.height(), filterSize, (ImageFilterType)filterType, filter);
+    generateFilter(fftWidth, fftHeight, filterSize, (ImageFilterType)filterType, filter);
 
-    imageFilterFFT2D(shiftedSpectrum, srcImage.width(), srcImage.height(), filter,
-                          filteredSpectrumImage, dstImage);
+    filterImage();
     filteredSpectrumImageLabel->setPixmap(QPixmap::fromImage(filteredSpectrumImage));
     dstImageLabel->setPixmap(QPixmap::fromImage(dstImage));
 }
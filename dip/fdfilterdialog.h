@@ -17,6 +17,7 @@
 #include "imageprocess.h"
 #include "transform.h"
 #include "floatslider.h"
+#include "scratcharena.h"
 
 QT_BEGIN_NAMESPACE
 class QAction;
@@ -39,29 +40,24 @@ class FDFilterDialog : public QDialog
     Q_OBJECT
 public:
     FDFilterDialog(QImage inputImage);
-    ~FDFilterDialog()
-    {
-        if (rgb)
-            delete [] rgb;
-        if (filter)
-            delete [] filter;
-        if (shiftedSpectrum)
-            fftwf_free(shiftedSpectrum);
-        if (spectrum)
-            fftwf_free(spectrum);
-    }
     QImage getImage() {return dstImage;}
 private:
     void iniUI();
+    void loadSpectrum();
+    void filterImage();
     QImage srcImage;
     QImage spectrumImage;
     QImage filteredSpectrumImage;
     QImage dstImage;
 
-    float *rgb = nullptr;
+    int cn = 3;
+    int fftWidth;                   // transform size, see fftPaddedSize()
+    int fftHeight;
+    ScratchScope dialogScratch;     // buffers that live as long as the dialog
     float *filter = nullptr;
-    fftwf_complex *shiftedSpectrum = nullptr;
-    fftwf_complex *spectrum = nullptr;
+    QByteArray shiftedSpectrum;     // cn*fftWidth*fftHeight fftwf_complex, from the artifact cache
+    bool lumaOnly = false;          // one spectrum of the Y plane instead of one per channel
+    QByteArray lumaChroma;          // y, cr and cb planes in luma only mode
     QLabel *srcImageLabel;
     QLabel *spectrumImageLabel;
     QLabel *filteredSpectrumImageLabel;
@@ -75,6 +71,8 @@ private:
     QLabel *filterSizeLabel;
     QLabel *filterTypeLabel;
     QComboBox *filterTypeComboBox;
+    QLabel *channelsLabel;
+    QComboBox *channelsComboBox;
 
     QPushButton     *btnOK;
     QPushButton     *btnCancel;
@@ -0,0 +1,247 @@
+#include "gaussian.h"
+#include "imageprocess.h"
+#include "artifactcache.h"
+#include "scratcharena.h"
+
+// Young - van Vliet recursive gaussian, w[n] = B*x[n] + (b1*w[n-1] + b2*w[n-2] + b3*w[n-3]) / b0
+struct RecursiveGaussian
+{
+    float B;
+    float b1, b2, b3;   // already divided by b0
+};
+
+static RecursiveGaussian recursiveGaussianCoefficients(float sigma)
+{
+    double s = sigma < 0.5f ? 0.5 : sigma;
+    double q = s >= 2.5 ? 0.98711*s - 0.96330 : 3.97156 - 4.14554*sqrt(1 - 0.26891*s);
+    double q2 = q*q;
+    double q3 = q2*q;
+    double b0 = 1.57825 + 2.44413*q + 1.4281*q2 + 0.422205*q3;
+    double b1 = 2.44413*q + 2.85619*q2 + 1.26661*q3;
+    double b2 = -(1.4281*q2 + 1.26661*q3);
+    double b3 = 0.422205*q3;
+
+    RecursiveGaussian c;
+    c.b1 = (float)(b1 / b0);
+    c.b2 = (float)(b2 / b0);
+    c.b3 = (float)(b3 / b0);
+    c.B = 1 - (c.b1 + c.b2 + c.b3);
+    return c;
+}
+
+/*
+*Summary: causal and anti-causal pass over one line, in place
+*Describtion:
+*    The filter states start from the edge values, which is the steady state of a replicated border.
+*/
+
+static void blurLine(float *line, int n, const RecursiveGaussian &c)
+{
+    float w1 = line[0], w2 = line[0], w3 = line[0];
+    for (int i=0; i<n; i++)
+    {
+        float w0 = c.B*line[i] + c.b1*w1 + c.b2*w2 + c.b3*w3;
+        line[i] = w0;
+        w3 = w2;
+        w2 = w1;
+        w1 = w0;
+    }
+
+    float y1 = line[n-1], y2 = line[n-1], y3 = line[n-1];
+    for (int i=n-1; i>=0; i--)
+    {
+        float y0 = c.B*line[i] + c.b1*y1 + c.b2*y2 + c.b3*y3;
+        line[i] = y0;
+        y3 = y2;
+        y2 = y1;
+        y1 = y0;
+    }
+}
+
+// blocked transposition of w*h values with row stride src_stride into h*w values with row stride dst_stride
+static void transposePlane(const float *src, int w, int h, int src_stride, float *dst, int dst_stride)
+{
+    const int block = 32;
+    int blocks_y = (h + block - 1) / block;
+#pragma omp parallel for
+    for (int by=0; by<blocks_y; by++)
+    {
+        int y0 = by*block;
+        int y1 = qMin(y0 + block, h);
+        for (int x0=0; x0<w; x0+=block)
+        {
+            int x1 = qMin(x0 + block, w);
+            for (int y=y0; y<y1; y++)
+                for (int x=x0; x<x1; x++)
+                    dst[x*dst_stride+y] = src[y*src_stride+x];
+        }
+    }
+}
+
+/*
+*Summary: gaussian blur with a fixed cost per pixel
+*Parameters:
+*    const float *src : planes*w*h input values, one plane after the other (may be the same as dst)
+*    int w : image width
+*    int h : image height
+*    int planes : number of planes
+*    float sigma : standard deviation of the gaussian (>= 0.5)
+*    float *dst : planes*w*h output values
+*Describtion:
+*    Third order recursive filter of Young and van Vliet, run forwards and backwards along every
+*    row, so the cost does not depend on sigma. Rows are filtered in parallel. For the columns the
+*    plane is transposed block by block, its rows filtered and transposed back, which keeps the
+*    recursion running along contiguous memory. The transposition goes through strips of as many
+*    columns as the scratch memory budget allows (see ScratchArena::fitUnits()).
+*/
+
+void gaussianBlur(const float *src, int w, int h, int planes, float sigma, float *dst)
+{
+    RecursiveGaussian c = recursiveGaussianCoefficients(sigma);
+    int n = w*h;
+    if (dst != src)
+        memcpy(dst, src, planes*n*sizeof(float));
+
+    ScratchScope scratch;
+    int strip_cols = ScratchArena::fitUnits(h*(qint64)sizeof(float), w);
+    float *transposed = scratch.alloc<float>((size_t)strip_cols*h);
+    for (int p=0; p<planes; p++)
+    {
+        float *plane = dst + p*n;
+
+#pragma omp parallel for
+        for (int j=0; j<h; j++)
+            blurLine(plane + j*w, w, c);
+
+        for (int x0=0; x0<w; x0+=strip_cols)
+        {
+            int cols = qMin(strip_cols, w-x0);
+            transposePlane(plane + x0, cols, h, w, transposed, h);
+#pragma omp parallel for
+            for (int i=0; i<cols; i++)
+                blurLine(transposed + i*h, h, c);
+            transposePlane(transposed, h, cols, h, plane + x0, w);
+        }
+    }
+}
+
+/*
+*Summary: gaussian blur of an image
+*Return:
+*    Format_Grayscale8 image for gray input, Format_RGB888 image otherwise,
+*    Format_Grayscale16 / Format_RGBX64 for 16 bit input
+*/
+
+QImage gaussianBlur(const QImage &image, float sigma)
+{
+    int w = image.width();
+    int h = image.height();
+    int n = w*h;
+    int cn = imageChannelCount(image);
+
+    QByteArray planes = ArtifactCache::instance().floatPlanes(image);
+    ScratchScope scratch("gaussianBlur");
+    float *blurred = scratch.alloc<float>(cn*n);
+    gaussianBlur((const float *)planes.constData(), w, h, cn, sigma, blurred);
+
+    QImage dst;
+    if (isHighBitDepth(image))
+    {
+        // 16 bit images are blurred and stored at their native precision
+        concatenateImagePlanes(blurred, w, h, cn, true, dst);
+        return dst;
+    }
+
+    uchar *pixels = scratch.alloc<uchar>(cn*n);
+#pragma omp parallel for
+    for (int i=0; i<n; i++)
+    {
+        for (int c=0; c<cn; c++)
+            pixels[i*cn+c] = (uchar)qBound(0.0f, blurred[c*n+i] + 0.5f, 255.0f);
+    }
+
+    concatenateImageChannel(pixels, w, h, cn, dst);
+    return dst;
+}
+
+/*
+*Summary: scale normalized laplacian of gaussian
+*Parameters:
+*    const QImage &image : input image
+*    float sigma : standard deviation of the gaussian
+*    uchar *dst : output w*h*cn interleaved values (see concatenateImageChannel()),
+*                 sigma^2 times the 4-neighbour laplacian of the blurred image, clamped to [0, 255]
+*Describtion:
+*    The image is smoothed by the recursive gaussian first, so the cost does not depend on sigma.
+*    The laplacian replicates the border.
+*/
+
+void laplacianOfGaussian(const QImage &image, float sigma, uchar *dst)
+{
+    int w = image.width();
+    int h = image.height();
+    int n = w*h;
+    int cn = imageChannelCount(image);
+
+    QByteArray planes = ArtifactCache::instance().floatPlanes(image);
+    ScratchScope scratch("laplacianOfGaussian");
+    float *blurred = scratch.alloc<float>(cn*n);
+    gaussianBlur((const float *)planes.constData(), w, h, cn, sigma, blurred);
+
+    float scale = sigma*sigma;
+    for (int c=0; c<cn; c++)
+    {
+        const float *g = blurred + c*n;
+#pragma omp parallel for
+        for (int j=0; j<h; j++)
+        {
+            const float *row = g + j*w;
+            const float *up = g + qMax(j-1, 0)*w;
+            const float *down = g + qMin(j+1, h-1)*w;
+            for (int i=0; i<w; i++)
+            {
+                float left = row[qMax(i-1, 0)];
+                float right = row[qMin(i+1, w-1)];
+                float val = scale*(up[i] + down[i] + left + right - 4*row[i]);
+                dst[(j*w+i)*cn+c] = (uchar)qBound(0.0f, val, 255.0f);
+            }
+        }
+    }
+}
+
+/*
+*Summary: difference of gaussians
+*Parameters:
+*    const QImage &image : input image
+*    float sigma : standard deviation of the narrow gaussian
+*    float k : ratio of the two standard deviations (> 1)
+*    uchar *dst : output w*h*cn interleaved values, (G(k*sigma) - G(sigma)) * 2/(k^2-1), which
+*                 approximates the scale normalized laplacian of gaussian, clamped to [0, 255]
+*/
+
+void differenceOfGaussians(const QImage &image, float sigma, float k, uchar *dst)
+{
+    int w = image.width();
+    int h = image.height();
+    int n = w*h;
+    int cn = imageChannelCount(image);
+
+    QByteArray planes = ArtifactCache::instance().floatPlanes(image);
+    const float *src = (const float *)planes.constData();
+    ScratchScope scratch("differenceOfGaussians");
+    float *narrow = scratch.alloc<float>(cn*n);
+    float *wide = scratch.alloc<float>(cn*n);
+    gaussianBlur(src, w, h, cn, sigma, narrow);
+    gaussianBlur(src, w, h, cn, k*sigma, wide);
+
+    float scale = 2 / (k*k - 1);
+#pragma omp parallel for
+    for (int i=0; i<n; i++)
+    {
+        for (int c=0; c<cn; c++)
+        {
+            float val = scale*(wide[c*n+i] - narrow[c*n+i]);
+            dst[i*cn+c] = (uchar)qBound(0.0f, val, 255.0f);
+        }
+    }
+}
@@ -0,0 +1,11 @@
+#ifndef GAUSSIAN_H
+#define GAUSSIAN_H
+
+#include <QImage>
+
+void gaussianBlur(const float *src, int w, int h, int planes, float sigma, float *dst);
+QImage gaussianBlur(const QImage &image, float sigma);
+void laplacianOfGaussian(const QImage &image, float sigma, uchar *dst);
+void differenceOfGaussians(const QImage &image, float sigma, float k, uchar *dst);
+
+#endif // GAUSSIAN_H
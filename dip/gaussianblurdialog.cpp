@@ -0,0 +1,78 @@
+#include "gaussianblurdialog.h"
+
+GaussianBlurDialog::GaussianBlurDialog(QImage inputImage)
+{
+    srcImage = inputImage;
+
+    dstImage = gaussianBlur(srcImage, sigma);
+
+    iniUI();
+
+    srcImageLabel->setPixmap(QPixmap::fromImage(srcImage));
+    dstImageLabel->setPixmap(QPixmap::fromImage(dstImage));
+}
+
+void GaussianBlurDialog::iniUI()
+{
+    // two image labels
+    srcImageLabel = new QLabel();
+    srcImageLabel->setAlignment(Qt::AlignCenter);
+    dstImageLabel = new QLabel();
+    dstImageLabel->setAlignment(Qt::AlignCenter);
+
+    // standard deviation, the recursive filter costs the same for any sigma
+    sigmaLabel = new QLabel(tr("Sigma"));
+    sigmaSlider = new FloatSlider(Qt::Horizontal);
+    sigmaEdit = new QLineEdit();
+    sigmaLabel->setMinimumWidth(30);
+    sigmaLabel->setAlignment(Qt::AlignRight);
+    sigmaEdit->setMinimumWidth(16);
+    sigmaSlider->setFloatRange(0.5f, 100);
+    sigmaSlider->setFloatStep(0.5f);
+    sigmaSlider->setFloatValue(sigma);
+    sigmaEdit->setText(QString::number(sigma, 'f', 2));
+
+    // signal slot
+    connect(sigmaSlider, SIGNAL(floatValueChanged(float)), this, SLOT(updateDstImage(float)));
+
+    // three buttons
+    btnOK = new QPushButton(tr("OK"));
+    btnCancel = new QPushButton(tr("Cancel"));
+    btnClose = new QPushButton(tr("Exit"));
+
+    connect(btnOK, SIGNAL(clicked()), this, SLOT(accept()));
+    connect(btnCancel, SIGNAL(clicked()), this, SLOT(reject()));
+    connect(btnClose, SIGNAL(clicked()), this, SLOT(close()));
+
+    QHBoxLayout *layout1 = new QHBoxLayout;
+    layout1->addWidget(srcImageLabel);
+    layout1->addWidget(dstImageLabel);
+
+    QHBoxLayout *layout2 = new QHBoxLayout;
+    layout2->addWidget(sigmaLabel, 2);
+    layout2->addWidget(sigmaSlider, 6);
+    layout2->addWidget(sigmaEdit, 2);
+
+    QHBoxLayout *layout3=new QHBoxLayout;
+    layout3->addStretch();
+    layout3->addWidget(btnOK);
+    layout3->addWidget(btnCancel);
+    layout3->addStretch();
+    layout3->addWidget(btnClose);
+
+    // main layout
+    QVBoxLayout *mainlayout = new QVBoxLayout;
+    mainlayout->addLayout(layout1, 8);
+    mainlayout->addLayout(layout2, 1);
+    mainlayout->addLayout(layout3, 1);
+    setLayout(mainlayout);
+}
+
+void GaussianBlurDialog::updateDstImage(float value)
+{
+    sigma = value;
+    sigmaEdit->setText(QString::number(value, 'f', 2));
+
+    dstImage = gaussianBlur(srcImage, sigma);
+    dstImageLabel->setPixmap(QPixmap::fromImage(dstImage));
+}
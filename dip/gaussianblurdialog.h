@@ -0,0 +1,53 @@
+#ifndef GAUSSIANBLURDIALOG_H
+#define GAUSSIANBLURDIALOG_H
+
+#include <QDialog>
+#include <QLabel>
+#include <QSlider>
+#include <QBoxLayout>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QImage>
+#include "gaussian.h"
+#include "floatslider.h"
+
+QT_BEGIN_NAMESPACE
+class QLabel;
+class QSlider;
+class QLineEdit;
+class QPushButton;
+class QBoxLayout;
+class QHBoxLayout;
+class QVBoxLayout;
+QT_END_NAMESPACE
+
+class GaussianBlurDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    GaussianBlurDialog(QImage inputImage);
+    QImage getImage() {return dstImage;}
+private:
+    void iniUI();
+    QImage srcImage;
+    QImage dstImage;
+    QLabel *srcImageLabel;
+    QLabel *dstImageLabel;
+
+    FloatSlider *sigmaSlider;
+    QLineEdit *sigmaEdit;
+    QLabel *sigmaLabel;
+
+    QPushButton     *btnOK;
+    QPushButton     *btnCancel;
+    QPushButton     *btnClose;
+
+    float sigma = 2.0f;
+
+private slots:
+    void updateDstImage(float value);
+};
+
+#endif // GAUSSIANBLURDIALOG_H
@@ -0,0 +1,220 @@
+#include "imagehistory.h"
+
+/*
+*Summary: find the tiles that differ between two images of the same size and format
+*Parameters:
+*    const QImage &before : image before the operation
+*    const QImage &after : image after the operation
+*    int tileSize : tile width and height in pixels
+*Return:
+*    the rectangles (in pixels, clipped to the image) of all changed tiles
+*/
+
+QVector<QRect> changedTileRects(const QImage &before, const QImage &after, int tileSize)
+{
+    QVector<QRect> rects;
+    if (before.cacheKey() == after.cacheKey())  // same pixel buffer, nothing changed
+        return rects;
+
+    int width = before.width();
+    int height = before.height();
+    int bpp = before.depth()/8;
+    for (int ty=0; ty<height; ty+=tileSize)
+    {
+        int th = std::min(tileSize, height-ty);
+        for (int tx=0; tx<width; tx+=tileSize)
+        {
+            int tw = std::min(tileSize, width-tx);
+            // compare the tile row by row, stop at the first difference
+            for (int j=ty; j<ty+th; j++)
+            {
+                if (memcmp(before.constScanLine(j)+tx*bpp, after.constScanLine(j)+tx*bpp, tw*bpp) != 0)
+                {
+                    rects.append(QRect(tx, ty, tw, th));
+                    break;
+                }
+            }
+        }
+    }
+    return rects;
+}
+
+ImageHistory::ImageHistory()
+{
+    current = 0;
+    evicted = 0;
+    savePoint = 0;
+    budget = 512*1024*1024LL;
+    usedBytes = 0;
+    compression = false;
+}
+
+void ImageHistory::setMemoryBudget(qint64 bytes)
+{
+    budget = bytes;
+    evict();
+}
+
+void ImageHistory::clear()
+{
+    steps.clear();
+    current = 0;
+    evicted = 0;
+    savePoint = 0;
+    usedBytes = 0;
+}
+
+/*
+*Summary: record an operation which replaced the image "before" with "after"
+*Describtion:
+*    If size and format are unchanged only the changed tiles of "before" are stored,
+*    otherwise the whole "before" image is kept (shallow copy, no pixel data is copied).
+*    All steps that could be redone are dropped, a save point among them can never be reached again.
+*/
+
+void ImageHistory::record(const QImage &before, const QImage &after)
+{
+    if (before.isNull())
+        return;
+
+    QVector<QRect> rects;
+    bool whole = before.size() != after.size() || before.format() != after.format() || before.depth() < 8;
+    if (!whole)
+    {
+        rects = changedTileRects(before, after, TileSize);
+        if (rects.isEmpty())
+            return;
+    }
+
+    while (steps.size() > current)
+    {
+        usedBytes -= steps.last().bytes;
+        steps.removeLast();
+    }
+    if (savePoint > evicted + current)
+        savePoint = -1;
+
+    Step step;
+    step.bytes = 0;
+    if (whole)
+    {
+        step.image = before;
+        step.bytes = before.sizeInBytes();
+    }
+    else
+    {
+        step.tiles.reserve(rects.size());
+        foreach (const QRect &rect, rects)
+        {
+            Tile tile;
+            tile.rect = rect;
+            tile.data = packTile(before, rect, tile.compressed);
+            step.bytes += tile.data.size();
+            step.tiles.append(tile);
+        }
+    }
+
+    steps.append(step);
+    current++;
+    usedBytes += step.bytes;
+    evict();
+}
+
+bool ImageHistory::undo(QImage &image)
+{
+    if (!canUndo())
+        return false;
+    current--;
+    swapStep(steps[current], image);
+    return true;
+}
+
+bool ImageHistory::redo(QImage &image)
+{
+    if (!canRedo())
+        return false;
+    swapStep(steps[current], image);
+    current++;
+    return true;
+}
+
+/*
+*Summary: exchange the content stored in a step with the content of the image
+*Describtion:
+*    After the swap the step holds exactly what is needed to revert the swap,
+*    so the same step serves both undo and redo. Only the tiles of the step are touched,
+*    but an image that shares its pixels with a view or the artifact cache is deep copied
+*    once before the first tile is written (copy-on-write), which costs O(image) instead of
+*    O(changed tiles).
+*/
+
+void ImageHistory::swapStep(Step &step, QImage &image)
+{
+    usedBytes -= step.bytes;
+    step.bytes = 0;
+    if (!step.image.isNull())
+    {
+        image.swap(step.image);
+        step.bytes = step.image.sizeInBytes();
+    }
+    else
+    {
+        image.detach();     // once here, scanLine() in unpackTile() then writes in place
+        for (int i=0; i<step.tiles.size(); i++)
+        {
+            Tile &tile = step.tiles[i];
+            bool compressed;
+            QByteArray data = packTile(image, tile.rect, compressed);
+            unpackTile(tile, image);
+            tile.data = data;
+            tile.compressed = compressed;
+            step.bytes += tile.data.size();
+        }
+    }
+    usedBytes += step.bytes;
+}
+
+QByteArray ImageHistory::packTile(const QImage &image, const QRect &rect, bool &compressed) const
+{
+    int bpp = image.depth()/8;
+    int rowBytes = rect.width()*bpp;
+    QByteArray data(rowBytes*rect.height(), Qt::Uninitialized);
+    char *p = data.data();
+    for (int j=rect.top(); j<=rect.bottom(); j++, p+=rowBytes)
+        memcpy(p, image.constScanLine(j)+rect.left()*bpp, rowBytes);
+
+    compressed = false;
+    if (compression)
+    {
+        // fast compression level, keep the raw tile if it does not pay off
+        QByteArray packed = qCompress(data, 1);
+        if (packed.size() < data.size())
+        {
+            compressed = true;
+            return packed;
+        }
+    }
+    return data;
+}
+
+void ImageHistory::unpackTile(const Tile &tile, QImage &image) const
+{
+    QByteArray data = tile.compressed ? qUncompress(tile.data) : tile.data;
+    int bpp = image.depth()/8;
+    int rowBytes = tile.rect.width()*bpp;
+    const char *p = data.constData();
+    for (int j=tile.rect.top(); j<=tile.rect.bottom(); j++, p+=rowBytes)
+        memcpy(image.scanLine(j)+tile.rect.left()*bpp, p, rowBytes);
+}
+
+// drop the oldest steps until the history fits into the memory budget
+void ImageHistory::evict()
+{
+    while (usedBytes > budget && current > 0)
+    {
+        usedBytes -= steps.first().bytes;
+        steps.removeFirst();
+        current--;
+        evicted++;
+    }
+}
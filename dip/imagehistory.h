@@ -0,0 +1,71 @@
+#ifndef IMAGEHISTORY_H
+#define IMAGEHISTORY_H
+
+#include <QImage>
+#include <QByteArray>
+#include <QVector>
+#include <QList>
+#include <QRect>
+
+QVector<QRect> changedTileRects(const QImage &before, const QImage &after, int tileSize);
+
+/*
+ * Undo/redo history of an image. The image is split into TileSize x TileSize tiles
+ * and every step only keeps the tiles that were changed by the operation. Tile data
+ * is held in implicitly shared (copy-on-write) QByteArrays, optionally compressed,
+ * and the whole history is bounded by a memory budget (oldest steps are evicted first).
+ * The save point remembers which step matches the file on disk, so undoing or redoing
+ * back to it leaves the image unmodified.
+ */
+class ImageHistory
+{
+public:
+    enum { TileSize = 256 };
+
+    ImageHistory();
+
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const { return budget; }
+    void setCompression(bool enabled) { compression = enabled; }
+    bool hasCompression() const { return compression; }
+    qint64 memoryUsage() const { return usedBytes; }
+
+    void clear();
+    void record(const QImage &before, const QImage &after);
+    bool canUndo() const { return current > 0; }
+    bool canRedo() const { return current < steps.size(); }
+    bool undo(QImage &image);
+    bool redo(QImage &image);
+    void markSaved() { savePoint = evicted + current; }
+    bool isAtSavePoint() const { return savePoint == evicted + current; }
+
+private:
+    struct Tile
+    {
+        QRect rect;
+        QByteArray data;
+        bool compressed;
+    };
+
+    struct Step
+    {
+        QImage image;           // whole image, used when size or format changed
+        QVector<Tile> tiles;    // changed tiles otherwise
+        qint64 bytes;
+    };
+
+    void swapStep(Step &step, QImage &image);
+    QByteArray packTile(const QImage &image, const QRect &rect, bool &compressed) const;
+    void unpackTile(const Tile &tile, QImage &image) const;
+    void evict();
+
+    QList<Step> steps;
+    int current;                // steps[0, current) can be undone, steps[current, size) redone
+    qint64 evicted;             // steps dropped from the front, evicted+current never repeats a position
+    qint64 savePoint;           // evicted+current when the image was saved, -1 if that state is gone
+    qint64 budget;
+    qint64 usedBytes;
+    bool compression;
+};
+
+#endif // IMAGEHISTORY_H
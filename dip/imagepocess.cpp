@@ -1,4 +1,8 @@
 #include "imageprocess.h"
+#include "artifactcache.h"
+#include "padding.h"
+#include "scratcharena.h"
+#include <QVector>
 
 /*
 *Summary: zero padding for filtering operations
@@ -21,21 +25,13 @@ void paddingZeros(const float *r, const float *g, const float *b,
                    const int half_pad_width, const int half_pad_height,
                    float *nr, float *ng, float *nb)
 {
-    int nw = width + 2*half_pad_width;
-    int nh = height + 2*half_pad_height;
-
-    // set the value of the first nh*nw*sizeof(float) bytes of the memory space nr/ng/nb to the value 0
-    memset(nr, 0, nh*nw*sizeof(float));
-    memset(ng, 0, nh*nw*sizeof(float));
-    memset(nb, 0, nh*nw*sizeof(float));
-
-    for (int j = half_pad_height; j < nh-half_pad_height; j++) {
-        // Copy the values of "width*sizeof(float)" bytes from the location pointed to by source directly ("r+(j-half_pad_height)*width")
-        // to the memory block pointed to by destination.
-        memcpy(nr+j*nw+half_pad_width, r+(j-half_pad_height)*width, width*sizeof(float));
-        memcpy(ng+j*nw+half_pad_width, g+(j-half_pad_height)*width, width*sizeof(float));
-        memcpy(nb+j*nw+half_pad_width, b+(j-half_pad_height)*width, width*sizeof(float));
-    }
+    const float zero = 0;
+    copyMakeBorder(r, width, height, 1, half_pad_height, half_pad_height, half_pad_width, half_pad_width,
+                   BORDER_CONSTANT, &zero, nr);
+    copyMakeBorder(g, width, height, 1, half_pad_height, half_pad_height, half_pad_width, half_pad_width,
+                   BORDER_CONSTANT, &zero, ng);
+    copyMakeBorder(b, width, height, 1, half_pad_height, half_pad_height, half_pad_width, half_pad_width,
+                   BORDER_CONSTANT, &zero, nb);
 }
 
 /*
@@ -115,6 +111,195 @@ void splitImageChannel(QImage &image, uchar *rgb)
     }
 }
 
+/*
+*Summary: number of channels an operation has to process for this image
+*Return:
+*    1 for Grayscale8 images and for color images whose pixels are all gray, 3 otherwise
+*Describtion:
+*    The scan of color images is cached per QImage::cacheKey(), most operations ask several times.
+*/
+
+int imageChannelCount(const QImage &image)
+{
+    if (image.format() == QImage::Format_Grayscale8)
+        return 1;
+    return ArtifactCache::instance().channelCount(image);
+}
+
+/*
+*Summary: whether the image has more than 8 bits per channel
+*Describtion:
+*    Format_Grayscale16 and the 64 bit rgb formats (Qt 5.13), e.g. 12/16 bit microscopy and X-ray
+*    images. Their float planes keep the full precision (see splitImagePlanes()) and the float based
+*    operations give 16 bit results (see concatenateImagePlanes()).
+*/
+
+bool isHighBitDepth(const QImage &image)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+    switch (image.format())
+    {
+    case QImage::Format_Grayscale16:
+    case QImage::Format_RGBX64:
+    case QImage::Format_RGBA64:
+    case QImage::Format_RGBA64_Premultiplied:
+        return true;
+    default:
+        break;
+    }
+#else
+    Q_UNUSED(image);
+#endif
+    return false;
+}
+
+/*
+*Summary: obtain the pixels of an image as cn interleaved channels
+*Parameters:
+*    QImage &image : orginal image
+*    uchar *pixels : w*h*cn values, the gray plane for cn == 1, interleaved r, g, b for cn == 3
+*    int cn : channel count, see imageChannelCount()
+*/
+
+void splitImageChannel(QImage &image, uchar *pixels, int cn)
+{
+    if (cn == 3)
+    {
+        splitImageChannel(image, pixels);
+        return;
+    }
+    int width = image.width();
+    QImage gray = ArtifactCache::instance().grayImage(image);
+    for (int j=0; j<image.height(); j++)
+        memcpy(pixels+j*width, gray.constScanLine(j), width);
+}
+
+/*
+*Summary: obtain the pixels of an image as cn float planes
+*Parameters:
+*    QImage &image : orginal image
+*    float *planes : w*h*cn values, the gray plane for cn == 1, r, g and b planes for cn == 3
+*    int cn : channel count, see imageChannelCount()
+*/
+
+void splitImagePlanes(QImage &image, float *planes, int cn)
+{
+    int width = image.width();
+    int height = image.height();
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+    if (isHighBitDepth(image))
+    {
+        // native 16 bit values in the 0..255 range of the 8 bit paths, the fraction keeps the low bits
+        const float scale = 1.0f/257;
+        int n = width*height;
+        if (cn == 1)
+        {
+            QImage gray = image.convertToFormat(QImage::Format_Grayscale16);
+#pragma omp parallel for
+            for (int j=0; j<height; j++)
+            {
+                const quint16 *p = (const quint16 *)gray.constScanLine(j);
+                for (int i=0; i<width; i++)
+                    planes[j*width+i] = p[i]*scale;
+            }
+        }
+        else
+        {
+            QImage rgb = image.convertToFormat(QImage::Format_RGBX64);
+#pragma omp parallel for
+            for (int j=0; j<height; j++)
+            {
+                const QRgba64 *p = (const QRgba64 *)rgb.constScanLine(j);
+                for (int i=0; i<width; i++)
+                {
+                    planes[j*width+i] = p[i].red()*scale;
+                    planes[n+j*width+i] = p[i].green()*scale;
+                    planes[2*n+j*width+i] = p[i].blue()*scale;
+                }
+            }
+        }
+        return;
+    }
+#endif
+    if (cn == 3)
+    {
+        splitImageChannel(image, planes, planes+width*height, planes+2*width*height);
+        return;
+    }
+    QImage gray = ArtifactCache::instance().grayImage(image);
+    for (int j=0; j<height; j++)
+    {
+        const uchar *p = gray.constScanLine(j);
+        for (int i=0; i<width; i++)
+            planes[j*width+i] = p[i];
+    }
+}
+
+/*
+*Summary: Combine cn interleaved channels into an image
+*Parameters:
+*    const uchar *pixels : w*h*cn values, see splitImageChannel()
+*    int w : the image width
+*    int h : the image height
+*    int cn : channel count
+*    QImage &image : Format_Grayscale8 image for cn == 1, Format_RGB888 image for cn == 3
+*/
+
+void concatenateImageChannel(const uchar *pixels, int w, int h, int cn, QImage &image)
+{
+    image = QImage(w, h, cn == 1 ? QImage::Format_Grayscale8 : QImage::Format_RGB888);
+    for (int j=0; j<h; j++)
+        memcpy(image.scanLine(j), pixels+j*w*cn, w*cn);
+}
+
+/*
+*Summary: Combine cn float planes into an image
+*Parameters:
+*    const float *planes : w*h*cn values in the 0..255 range, see splitImagePlanes()
+*    int cn : channel count
+*    bool deep : Format_Grayscale16 / Format_RGBX64 result instead of Format_Grayscale8 / Format_RGB888
+*    QImage &image : output image
+*Describtion:
+*    8 bit results are truncated like the uchar paths, 16 bit results are rounded to 257 steps per
+*    8 bit step, so nothing is quantized to 8 bits on the way.
+*/
+
+void concatenateImagePlanes(const float *planes, int w, int h, int cn, bool deep, QImage &image)
+{
+    int n = w*h;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+    if (deep)
+    {
+        image = QImage(w, h, cn == 1 ? QImage::Format_Grayscale16 : QImage::Format_RGBX64);
+#pragma omp parallel for
+        for (int j=0; j<h; j++)
+        {
+            quint16 *p = (quint16 *)image.scanLine(j);
+            int step = cn == 1 ? 1 : 4;
+            for (int i=0; i<w; i++)
+            {
+                for (int c=0; c<cn; c++)
+                    p[i*step+c] = (quint16)qBound(0.0f, planes[c*n+j*w+i]*257 + 0.5f, 65535.0f);
+                if (cn == 3)
+                    p[i*step+3] = 65535;
+            }
+        }
+        return;
+    }
+#else
+    Q_UNUSED(deep);
+#endif
+    image = QImage(w, h, cn == 1 ? QImage::Format_Grayscale8 : QImage::Format_RGB888);
+#pragma omp parallel for
+    for (int j=0; j<h; j++)
+    {
+        uchar *p = image.scanLine(j);
+        for (int i=0; i<w; i++)
+            for (int c=0; c<cn; c++)
+                p[i*cn+c] = (uchar)qBound(0, (int)planes[c*n+j*w+i], 255);
+    }
+}
+
 /*
 *Summary: Combine three image channels into rgb image
 *Parameters:
@@ -188,7 +373,8 @@ void concatenateImageChannel(uchar *rgb, int w, int h, QImage &image)
 *    float *cb: the blue-difference chroma component
 */
 
-void rgb2ycrcb(uchar *r, uchar *g, uchar *b, int size, float *y, float *cr, float *cb)
+template <typename T>
+static void rgb2ycrcbProc(const T *r, const T *g, const T *b, int size, float *y, float *cr, float *cb)
 {
     for (int i=0; i<size; i++)
     {
@@ -198,13 +384,40 @@ void rgb2ycrcb(uchar *r, uchar *g, uchar *b, int size, float *y, float *cr, floa
     }
 }
 
+void rgb2ycrcb(uchar *r, uchar *g, uchar *b, int size, float *y, float *cr, float *cb)
+{
+    rgb2ycrcbProc(r, g, b, size, y, cr, cb);
+}
+
+// float planes in the 0..255 scale (see splitImagePlanes()), also for 16 bit images
+void rgb2ycrcb(const float *r, const float *g, const float *b, int size, float *y, float *cr, float *cb)
+{
+    rgb2ycrcbProc(r, g, b, size, y, cr, cb);
+}
+
+static inline double ycrcb2red(double y, double cr) { return 1.164383 * (y-16) + 1.596027 * (cr-128); }
+static inline double ycrcb2green(double y, double cr, double cb) { return 1.164383 * (y-16) - 0.391762 * (cb-128)- 0.812969 * (cr-128); }
+static inline double ycrcb2blue(double y, double cb) { return 1.164383 * (y-16) + 2.017230 * (cb-128); }
+
 void ycrcb2rgb(float *y, float *cr, float *cb, int size, uchar *r, uchar *g, uchar *b)
 {
     for (int i=0; i<size; i++)
     {
-        r[i] = 1.164383 * (y[i]-16) + 1.596027 * (cr[i]-128);
-        g[i] = 1.164383 * (y[i]-16) - 0.391762 * (cb[i]-128)- 0.812969 * (cr[i]-128);
-        b[i] = 1.164383 * (y[i]-16) + 2.017230 * (cb[i]-128);
+        // rounded and clamped, a plain conversion would truncate and wrap around out of range values
+        r[i] = (uchar)qBound(0.0, ycrcb2red(y[i], cr[i]) + 0.5, 255.0);
+        g[i] = (uchar)qBound(0.0, ycrcb2green(y[i], cr[i], cb[i]) + 0.5, 255.0);
+        b[i] = (uchar)qBound(0.0, ycrcb2blue(y[i], cb[i]) + 0.5, 255.0);
+    }
+}
+
+// float planes, neither rounded nor clamped (see concatenateImagePlanes())
+void ycrcb2rgb(const float *y, const float *cr, const float *cb, int size, float *r, float *g, float *b)
+{
+    for (int i=0; i<size; i++)
+    {
+        r[i] = (float)ycrcb2red(y[i], cr[i]);
+        g[i] = (float)ycrcb2green(y[i], cr[i], cb[i]);
+        b[i] = (float)ycrcb2blue(y[i], cb[i]);
     }
 }
 
@@ -212,7 +425,8 @@ void qimage2ycrcb(QImage image, float *y, float *cr, float *cb)
 {
     int pixel_num = image.width()*image.height();
     // obtain image channels
-    uchar *channels = new uchar[pixel_num*3];
+    ScratchScope scratch;
+    uchar *channels = scratch.alloc<uchar>(pixel_num*3);
     uchar *r = channels;
     uchar *g = channels+pixel_num;
     uchar *b = channels+2*pixel_num;
@@ -220,15 +434,14 @@ void qimage2ycrcb(QImage image, float *y, float *cr, float *cb)
 
     // rgb to ycrcb
     rgb2ycrcb(r, g, b, pixel_num, y, cr, cb);
-
-    delete [] channels;
 }
 
 void ycrcb2qimage(float *y, float *cr, float *cb, int width, int height, QImage &image)
 {
     int pixel_num = width*height;
 
-    uchar *channels = new uchar[pixel_num*3];
+    ScratchScope scratch;
+    uchar *channels = scratch.alloc<uchar>(pixel_num*3);
     uchar *r = channels;
     uchar *g = channels+pixel_num;
     uchar *b = channels+2*pixel_num;
@@ -248,7 +461,6 @@ void ycrcb2qimage(float *y, float *cr, float *cb, int width, int height, QImage
             image.setPixel(i, j, qRgb(nr,ng,nb));
         }
     }
-    delete [] channels;
 }
 
 /*
@@ -260,48 +472,28 @@ void ycrcb2qimage(float *y, float *cr, float *cb, int width, int height, QImage
 
 QImage calculateHistogram(QImage &image, ImageChannel channel)
 {
-    // obtain gray image
-    QImage grayImage = image.convertToFormat(QImage::Format_Grayscale8);
-    int width = grayImage.width();
-    int height = grayImage.height();
-    uchar *r = new uchar[width*height];
-    uchar *g = new uchar[width*height];
-    uchar *b = new uchar[width*height];
-
-    // seperate RGB channel
-    splitImageChannel(image, r, g, b);
-
     QRgb hist_ior;
-
-    uchar *bits = nullptr;
     switch (channel) {
         case ImageChannel::Y:
             hist_ior = qRgba(128, 128, 128, 255);
-            bits = grayImage.bits();
             break;
         case ImageChannel::R:
             hist_ior = qRgba(255, 0, 0, 255);
-            bits = r;
             break;
         case ImageChannel::G:
             hist_ior = qRgba(0, 255, 0, 255);
-            bits = g;
             break;
         case ImageChannel::B:
             hist_ior = qRgba(0, 0, 255, 255);
-            bits = b;
             break;
     }
 
     const int gray_level = 256;
-    int hist[gray_level] = {0};
+    int hist[gray_level];
 
-    // calculate histogram
-    for (int i=0; i<width*height; i++)
-    {
-       int val = bits[i];
-       hist[val]++;
-    }
+    // calculate histogram (shared with the other users of the same image)
+    QByteArray cached = ArtifactCache::instance().histogram(image, channel);
+    memcpy(hist, cached.constData(), gray_level*sizeof(int));
 
     // compress histogram into hist_image height
     int max_hist_val = hist[0];
@@ -334,9 +526,6 @@ QImage calculateHistogram(QImage &image, ImageChannel channel)
             hist_image.setPixel(i, j, value);
         }
     }
-    delete [] r;
-    delete [] g;
-    delete [] b;
 
     return hist_image;
 }
@@ -353,6 +542,18 @@ QImage calculateNegative(QImage &image, ImageChannel channel)
     int width = image.width();
     int height = image.height();
 
+    // gray input: a single channel to invert, the result stays gray
+    if (channel == ImageChannel::Y && imageChannelCount(image) == 1)
+    {
+        QImage grayImage = ArtifactCache::instance().grayImage(image).copy();
+        for (int j=0; j<height; j++) {
+            uchar *p = grayImage.scanLine(j);
+            for (int i=0; i<width; i++)
+                p[i] = 255-p[i];
+        }
+        return grayImage;
+    }
+
     QImage newImage = image; // Create a new QImage type image for return
     int r, g, b;
     // Traverse the entire image and modify the corresponding pixel value
@@ -451,25 +652,26 @@ QImage equalizeHistogramProc1(QImage &image)
     int pixel_num = width*height;
 
     // obtain image channels
-    uchar *channels = new uchar[pixel_num*3];
+    ScratchScope scratch("equalizeHistogram");
+    uchar *channels = scratch.alloc<uchar>(pixel_num*3);
     uchar *r = channels;
     uchar *g = channels+pixel_num;
     uchar *b = channels+2*pixel_num;
     splitImageChannel(image, r, g, b);
 
     // rgb to ycbcr
-    float *ycrcb = new float[pixel_num*3];
+    float *ycrcb = scratch.alloc<float>(pixel_num*3);
     float *y = ycrcb;
     float *cr = ycrcb+pixel_num;
     float *cb = ycrcb+2*pixel_num;
     rgb2ycrcb(r, g, b, pixel_num, y, cr, cb);
 
     // calculate hist/pdf
-    int *hist = new int[pixel_num]; // hist/pdf
+    int *hist = scratch.alloc<int>(pixel_num); // hist/pdf
     const int gray_level = 256;
-    float *gray_distribution = new float[gray_level];// cdf
+    float *gray_distribution = scratch.alloc<float>(gray_level);// cdf
 
-    uchar *gray_equal = new uchar[gray_level]; // equalized gray
+    uchar *gray_equal = scratch.alloc<uchar>(gray_level); // equalized gray
 
         // calculate pdf
         memset(hist, 0, pixel_num*sizeof(int));
@@ -516,11 +718,6 @@ QImage equalizeHistogramProc1(QImage &image)
             newImage.setPixel(i, j, qRgb(nr,ng,nb));
         }
     }
-    delete [] gray_equal;
-    delete [] gray_distribution;
-    delete [] channels;
-    delete [] ycrcb;
-
     return newImage;
 }
 
@@ -531,31 +728,32 @@ QImage equalizeHistogramProc(QImage &image)
     int pixel_num = width*height;
 
     // obtain gray image
-    uchar *channels = new uchar[width*height*3];    // dynamically allocate memory for the array of three channels' pixels(R,G,B)
+    // gray input: only one channel to equalize, g and b stay null
+    int cn = imageChannelCount(image);
+    ScratchScope scratch("equalizeHistogram");
+    uchar *channels = scratch.alloc<uchar>(width*height*cn);    // scratch memory for the array of three channels' pixels(R,G,B)
     uchar *r = channels; //the R channel is stored at the beginning of this memory space
     //the interval between the starting positions of the r,g,and b channels in the memory space is the space occupied by a grayscale image
-    uchar *g = channels+width*height;
-    uchar *b = channels+2*width*height;
-    splitImageChannel(image, r, g, b);
+    uchar *g = cn == 3 ? channels+width*height : 0;
+    uchar *b = cn == 3 ? channels+2*width*height : 0;
+    if (cn == 1)
+        splitImageChannel(image, r, 1);
+    else
+        splitImageChannel(image, r, g, b);
 
     uchar *c[4] = {r, g, b, 0};
+    ImageChannel channel[3] = {cn == 1 ? ImageChannel::Y : ImageChannel::R, ImageChannel::G, ImageChannel::B};
 
     // calculate hist/pdf(probability density function)
-    int *hist = new int[pixel_num]; // dynamically allocate memory for the array of hist
     const int gray_level = 256;
-    float *gray_distribution = new float[gray_level];// cdf
+    float *gray_distribution = scratch.alloc<float>(gray_level);// cdf
 
-    uchar *gray_equal = new uchar[gray_level]; // equalized gray
+    uchar *gray_equal = scratch.alloc<uchar>(gray_level); // equalized gray
     for (uchar **p=c; (*p) != 0; p++)
     {
-
-        memset(hist, 0, pixel_num*sizeof(int)); // set the value of the first pixel_num bytes of the allocated memory space hist to the value 0
-         // calculate hist
-        for (int i=0; i<pixel_num; i++)
-        {
-            int index = (*p)[i]; // gray scale
-            hist[index]++;
-        }
+        // channel histogram, shared with the histogram views of the same image
+        QByteArray cached = ArtifactCache::instance().histogram(image, channel[p-c]);
+        const int *hist = (const int *)cached.constData();
 
         memset(gray_distribution, 0, gray_level*sizeof(float)); // set the value of the first gray_level bytes of the allocated memory space gray_distribution to the value 0
 
@@ -582,21 +780,25 @@ QImage equalizeHistogramProc(QImage &image)
     }
 
     // update image
-    int count = 0;
-    QImage newImage = image; // grayImage;
-    for (int j=0; j<height; j++) {
-        for (int i=0; i<width; i++) {
-            int nr = r[count];
-            int ng = g[count];
-            int nb = b[count];
-            count++;
-            newImage.setPixel(i, j, qRgb(nr,ng,nb));
+    QImage newImage;
+    if (cn == 1)
+    {
+        concatenateImageChannel(r, width, height, 1, newImage);
+    }
+    else
+    {
+        int count = 0;
+        newImage = image; // grayImage;
+        for (int j=0; j<height; j++) {
+            for (int i=0; i<width; i++) {
+                int nr = r[count];
+                int ng = g[count];
+                int nb = b[count];
+                count++;
+                newImage.setPixel(i, j, qRgb(nr,ng,nb));
+            }
         }
     }
-    // release the occupied memory
-    delete [] gray_equal;
-    delete [] gray_distribution;
-    delete [] channels;
 
     return newImage;
 }
@@ -646,71 +848,66 @@ void filter(uchar *src, int image_width, int image_height,
 *
 *Parameters:
 *    QImage &src_image : input original image
-*    float *rgb : pointer to the starting location of orginal rgb image memory block
-*    float *rgb_ii : pointer to the starting location of integral image memory block
-*    float *rgb_ii_power : pointer to the starting location of integral image power memory block
-*    int max_window_size : the local area size
+*    const float *rgb : pointer to the starting location of orginal rgb image memory block, not padded
+*    const float *rgb_ii : pointer to the starting location of integral image memory block
+*    const float *rgb_ii_power : pointer to the starting location of integral image power memory block
 *    int half_window_size : half window size
 *    float alpha : constrast gain factor
 *    float max_cg : max cg
-*    QImage &dst_image : output enhanced image
+*    QImage &dst_image : output enhanced image, see concatenateImagePlanes()
 * Describtion: The procedures of the algorithm are as follows:
 *     (1) Calculate the low-frequency part of the image by low-pass filtering;
 *     (2) Get the high-frequency part of the image by subtracting the original image and the low-frequency component;
 *     (3) Amplify the high-frequency part and superimpose it with the low-frequency part, then we can get the enhanced image.
+*     The window is zero padded virtually: boxes are clipped to the image, the zeros outside add nothing
+*     to the sums, and the sums are still divided by the full window size.
 *
 */
-void adaptiveContrastEnhancement(QImage &src_image, float *rgb, float *rgb_ii, float *rgb_ii_power, int max_window_size,
+void adaptiveContrastEnhancement(QImage &src_image, int cn, const float *rgb, const float *rgb_ii, const float *rgb_ii_power,
                                  int half_window_size, float alpha, float max_cg, QImage &dst_image)
 {
-    dst_image = src_image;
     int image_width = src_image.width();
     int image_height = src_image.height();
     int pixel_num = image_width*image_height;
-
-    int max_image_width = src_image.width() + 2*max_window_size;
-    int max_image_height = src_image.height() + 2*max_window_size;
-    int max_pixel_num = max_image_width*max_image_height;
-    int max_kernel_height = 2*max_window_size+1;
-    int max_kernel_width = 2*max_window_size+1;
+    ScratchScope scratch("adaptiveContrastEnhancement");
+    float *enhanced = scratch.alloc<float>(cn*pixel_num);
 
     int i=0, j=0;
     int kernel_height = 2*half_window_size+1;
     int kernel_width = 2*half_window_size+1;
     int kernel_size = kernel_height*kernel_width;
     float image_mean=0, image_std=0;
-    for (int c=0; c<3; c++)
+    for (int c=0; c<cn; c++)
     {
         // image mean
-        image_mean = box_integral(rgb_ii+c*max_pixel_num, max_image_width, max_image_height,
-                               max_window_size, max_window_size + image_width-1,
-                               max_window_size, max_window_size + image_height-1);
+        image_mean = box_integral(rgb_ii+c*pixel_num, image_width, image_height,
+                               0, image_width-1, 0, image_height-1);
         image_mean /= pixel_num;
 
         // image std
-        image_std = box_integral(rgb_ii_power+c*max_pixel_num, max_image_width, max_image_height,
-                               max_window_size, max_window_size + image_width-1,
-                               max_window_size, max_window_size + image_height-1);
+        image_std = box_integral(rgb_ii_power+c*pixel_num, image_width, image_height,
+                               0, image_width-1, 0, image_height-1);
         image_std /= pixel_num;
         image_std -= image_mean*image_mean;
 
         image_std = sqrtf(image_std);
 
         // local area mean and std
-        for (j=max_kernel_height/2; j<max_image_height-max_kernel_height/2; j++)
+        for (j=0; j<image_height; j++)
         {
-            for (i=max_kernel_width/2; i<max_image_width-max_kernel_width/2; i++)
+            int r1 = qMax(j-half_window_size, 0);
+            int r2 = qMin(j+half_window_size, image_height-1);
+            for (i=0; i<image_width; i++)
             {
+                int c1 = qMax(i-half_window_size, 0);
+                int c2 = qMin(i+half_window_size, image_width-1);
+
                 // mean
-                float mean = box_integral(rgb_ii+c*max_pixel_num, max_image_width, max_image_height,
-                                       i-kernel_width/2, i+kernel_width/2,
-                                       j-kernel_height/2, j+kernel_height/2);
+                float mean = box_integral(rgb_ii+c*pixel_num, image_width, image_height, c1, c2, r1, r2);
                 mean /= kernel_size;
 
                 // std
-                float std= box_integral(rgb_ii_power+c*max_pixel_num, max_image_width, max_image_height,
-                                       i-kernel_width/2, i+kernel_width/2,
-                                       j-kernel_height/2, j+kernel_height/2);
+                float std= box_integral(rgb_ii_power+c*pixel_num, image_width, image_height, c1, c2, r1, r2);
                 std = std/kernel_size - mean*mean;
                 std = sqrtf(std);
 
@@ -719,20 +916,16 @@ void adaptiveContrastEnhancement(QImage &src_image, float *rgb, float *rgb_ii, f
                 if (cg>max_cg) cg = max_cg;
 
                 // Amplify the high-frequency part and superimpose it with the low-frequency part, then get the enhanced image.
-                float dst_val = mean + cg * (rgb[c*max_pixel_num + j*max_image_width+i] - mean);
+                float dst_val = mean + cg * (rgb[c*pixel_num + j*image_width+i] - mean);
                 if (dst_val > 255) dst_val = 255;
                 if (dst_val < 0) dst_val = 0;
-                QRgb temp = dst_image.pixel(i-max_kernel_width/2, j-max_kernel_height/2);
-                int temp_r = qRed(temp);
-                int temp_g = qGreen(temp);
-                int temp_b = qBlue(temp);
-                if (c==0) temp_r = dst_val;
-                if (c==1) temp_g = dst_val;
-                if (c==2) temp_b = dst_val;
-                dst_image.setPixel(i-max_kernel_width/2, j-max_kernel_height/2, qRgb(temp_r, temp_g, temp_b));
+                enhanced[c*pixel_num + j*image_width+i] = dst_val;
             }
         }
     }
+
+    // a gray image only has one plane and gives a gray result, 16 bit images stay 16 bit
+    concatenateImagePlanes(enhanced, image_width, image_height, cn, isHighBitDepth(src_image), dst_image);
 }
 
 /*
@@ -794,7 +987,7 @@ void calculate_integral_image_power(float *image, int width, int height, float *
 *Summary:
 *
 *Parameters:
-*    float *integral_image : input integral image
+*    const float *integral_image : input integral image
 *    int width : image width
 *    int height : image height
 *    int c1 :
@@ -802,7 +995,7 @@ void calculate_integral_image_power(float *image, int width, int height, float *
 *    int r1 :
 *    int r2 :
 */
-__inline float box_integral(float *integral_image, int width, int height, int c1, int c2, int r1, int r2)
+__inline float box_integral(const float *integral_image, int width, int height, int c1, int c2, int r1, int r2)
 {
     float a, b, c, d;
 
@@ -872,3 +1065,488 @@ void Dilation(QImage *src_image, QImage *dst_image)
         }
     }
 }
+
+// erosion or dilation of the rows in which the structure element fits, T is uchar or quint16
+template <typename T>
+static void morphologyRows(const QImage &src, const int *ox, const int *oy, int count, int half,
+                           bool dilate, QImage &dst)
+{
+    int width = src.width();
+    int height = src.height();
+    const T init = dilate ? 0 : (T)~0;
+#pragma omp parallel for
+    for (int y = half; y < height - half; y++)
+    {
+        T *d = (T *)dst.scanLine(y);
+        for (int x = half; x < width - half; x++)
+        {
+            T k = init;
+            for (int n = 0; n < count; n++)
+            {
+                T v = ((const T *)src.constScanLine(y + oy[n]))[x + ox[n]];
+                if (dilate ? v > k : v < k)
+                    k = v;
+            }
+            d[x] = k;
+        }
+    }
+}
+
+/*
+*Summary: single-channel erosion or dilation
+*Parameters:
+*    const QImage &src_image : input image, processed as its Format_Grayscale8 conversion
+*                              or as Format_Grayscale16 if it has 16 bits per channel
+*    const int *kernel : size_kernel*size_kernel structure element, indexed [x][y] like the color versions
+*    int size_kernel : structure element size
+*    bool dilate : take the maximum (dilation) instead of the minimum (erosion)
+*    QImage &dst_image : output image of the same gray format
+*Describtion:
+*    Same as the color morphology operations, the border which the structure element does not
+*    fit into keeps the original values.
+*/
+
+void grayMorphology(const QImage &src_image, const int *kernel, int size_kernel, bool dilate, QImage &dst_image)
+{
+    bool deep = isHighBitDepth(src_image);
+    QImage src;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+    if (deep)
+        src = src_image.convertToFormat(QImage::Format_Grayscale16);
+#endif
+    if (!deep)
+        src = ArtifactCache::instance().grayImage(src_image);
+    dst_image = src.copy();
+    int half = size_kernel / 2;
+
+    // offsets of the structure element, so the inner loop only visits its 1 entries
+    QVector<int> dx, dy;
+    for (int j = -half; j <= half; j++)
+        for (int i = -half; i <= half; i++)
+            if (kernel[(half + i)*size_kernel + half + j])
+            {
+                dx.append(i);
+                dy.append(j);
+            }
+
+    if (deep)
+        morphologyRows<quint16>(src, dx.constData(), dy.constData(), dx.size(), half, dilate, dst_image);
+    else
+        morphologyRows<uchar>(src, dx.constData(), dy.constData(), dx.size(), half, dilate, dst_image);
+}
+
+/*
+*Summary: contrast limited adaptive histogram equalization (CLAHE) of the luma
+*Parameters:
+*    const QImage &image : input original image
+*    int tiles_x : number of tiles in horizontal direction
+*    int tiles_y : number of tiles in vertical direction
+*    float clip_limit : histogram bins are clipped at clip_limit times the mean bin count
+*Return:
+*    Format_Grayscale8 image for gray input, Format_RGB888 image otherwise
+*Describtion:
+*    (1) The luma (the Grayscale8 conversion, shared through the artifact cache) is split into tiles,
+*        the histogram of every tile is clipped, the excess is redistributed over all bins and
+*        the clipped cdf gives the tile's lookup table. The tiles are independent and computed in parallel.
+*    (2) Every pixel is mapped through the lookup tables of the four nearest tile centers and the
+*        results are bilinearly interpolated. Row and column weights are computed once per row/column.
+*    (3) For color images the luma change is added to r, g and b, which keeps the chroma unchanged.
+*/
+
+QImage contrastLimitedEqualization(const QImage &image, int tiles_x, int tiles_y, float clip_limit)
+{
+    const int gray_level = 256;
+    QImage gray = ArtifactCache::instance().grayImage(image);
+    int width = gray.width();
+    int height = gray.height();
+    tiles_x = qBound(1, tiles_x, width);
+    tiles_y = qBound(1, tiles_y, height);
+    int tile_width = (width + tiles_x - 1) / tiles_x;
+    int tile_height = (height + tiles_y - 1) / tiles_y;
+    int tile_num = tiles_x*tiles_y;
+
+    // (1) clipped histogram and lookup table of every tile
+    ScratchScope scratch("contrastLimitedEqualization");
+    uchar *lut = scratch.alloc<uchar>(tile_num*gray_level);
+#pragma omp parallel for
+    for (int t=0; t<tile_num; t++)
+    {
+        int x0 = (t % tiles_x) * tile_width;
+        int y0 = (t / tiles_x) * tile_height;
+        int x1 = qMin(x0 + tile_width, width);
+        int y1 = qMin(y0 + tile_height, height);
+        int area = (x1 - x0) * (y1 - y0);
+
+        int hist[gray_level] = {0};
+        for (int j=y0; j<y1; j++)
+        {
+            const uchar *p = gray.constScanLine(j);
+            for (int i=x0; i<x1; i++)
+                hist[p[i]]++;
+        }
+
+        int limit = qMax(1, (int)(clip_limit * area / gray_level));
+        int excess = 0;
+        for (int i=0; i<gray_level; i++)
+        {
+            if (hist[i] > limit)
+            {
+                excess += hist[i] - limit;
+                hist[i] = limit;
+            }
+        }
+        int increment = excess / gray_level;
+        int residual = excess % gray_level;
+        for (int i=0; i<gray_level; i++)
+            hist[i] += increment + (i < residual ? 1 : 0);
+
+        uchar *tile_lut = lut + t*gray_level;
+        int cdf = 0;
+        float scale = (gray_level-1) * 1.0f / (area > 0 ? area : 1);
+        for (int i=0; i<gray_level; i++)
+        {
+            cdf += hist[i];
+            tile_lut[i] = (uchar)qMin(gray_level-1, (int)(cdf*scale + 0.5f));
+        }
+    }
+
+    // column weights: left tile and distance to its center, the same for every row
+    int *col_tile = scratch.alloc<int>(width);
+    float *col_weight = scratch.alloc<float>(width);
+    for (int i=0; i<width; i++)
+    {
+        float fx = (i + 0.5f) / tile_width - 0.5f;
+        int tx = (int)floorf(fx);
+        float wx = fx - tx;
+        if (tx < 0) { tx = 0; wx = 0; }
+        if (tx >= tiles_x-1) { tx = tiles_x-1; wx = 0; }
+        col_tile[i] = tx;
+        col_weight[i] = wx;
+    }
+
+    // (2) + (3) bilinear interpolation of the tile lookup tables
+    bool is_gray = imageChannelCount(image) == 1;
+    QImage newImage(width, height, is_gray ? QImage::Format_Grayscale8 : QImage::Format_RGB888);
+
+    // the usual color formats are read in place, others are converted to RGB32 a strip of
+    // rows at a time instead of copying the whole image
+    bool packed = image.format() == QImage::Format_RGB888;
+    bool in_place = is_gray || packed || image.format() == QImage::Format_RGB32
+                    || image.format() == QImage::Format_ARGB32;
+    int strip_rows = in_place ? height : ScratchArena::fitUnits(width*(qint64)sizeof(QRgb), height);
+
+    for (int s0=0; s0<height; s0+=strip_rows)
+    {
+        int rows = qMin(strip_rows, height-s0);
+        QImage strip = in_place ? image : image.copy(0, s0, width, rows).convertToFormat(QImage::Format_RGB32);
+        int strip_y0 = in_place ? 0 : s0;
+
+#pragma omp parallel for
+        for (int j=s0; j<s0+rows; j++)
+        {
+            float fy = (j + 0.5f) / tile_height - 0.5f;
+            int ty = (int)floorf(fy);
+            float wy = fy - ty;
+            if (ty < 0) { ty = 0; wy = 0; }
+            if (ty >= tiles_y-1) { ty = tiles_y-1; wy = 0; }
+            int ty1 = qMin(ty+1, tiles_y-1);
+
+            const uchar *p = gray.constScanLine(j);
+            const uchar *src = is_gray ? 0 : strip.constScanLine(j-strip_y0);
+            uchar *dst = newImage.scanLine(j);
+            for (int i=0; i<width; i++)
+            {
+                int tx = col_tile[i];
+                int tx1 = qMin(tx+1, tiles_x-1);
+                float wx = col_weight[i];
+                int v = p[i];
+                float top = (1-wx)*lut[(ty*tiles_x+tx)*gray_level+v] + wx*lut[(ty*tiles_x+tx1)*gray_level+v];
+                float bottom = (1-wx)*lut[(ty1*tiles_x+tx)*gray_level+v] + wx*lut[(ty1*tiles_x+tx1)*gray_level+v];
+                int y = (int)((1-wy)*top + wy*bottom + 0.5f);
+                if (is_gray)
+                {
+                    dst[i] = (uchar)y;
+                }
+                else
+                {
+                    int dy = y - v;
+                    QRgb rgb = packed ? qRgb(src[3*i], src[3*i+1], src[3*i+2]) : ((const QRgb *)src)[i];
+                    dst[3*i] = (uchar)qBound(0, qRed(rgb) + dy, 255);
+                    dst[3*i+1] = (uchar)qBound(0, qGreen(rgb) + dy, 255);
+                    dst[3*i+2] = (uchar)qBound(0, qBlue(rgb) + dy, 255);
+                }
+            }
+        }
+    }
+
+    return newImage;
+}
+
+/*
+*Summary: exact integral images of a gray image
+*Parameters:
+*    const QImage &gray : input Format_Grayscale8 image
+*    quint32 *integral_image : output (width+1)*(height+1) sums, the first row and column are zero
+*    quint64 *integral_image_power : output (width+1)*(height+1) sums of squares
+*Describtion:
+*    Integer sums never lose precision, unlike the float integral images whose low bits vanish
+*    on large images. The sums wrap around modulo 2^32, a box sum taken from four corners is still
+*    exact as long as the box holds less than 2^32/255 pixels. The squares can not overflow 64 bits.
+*    Rows are prefix-summed in parallel, the column pass adds whole rows and vectorizes.
+*/
+
+void calculate_exact_integral_images(const QImage &gray, quint32 *integral_image, quint64 *integral_image_power)
+{
+    int width = gray.width();
+    int height = gray.height();
+    int stride = width + 1;
+
+    memset(integral_image, 0, stride*sizeof(quint32));
+    memset(integral_image_power, 0, stride*sizeof(quint64));
+
+#pragma omp parallel for
+    for (int j=0; j<height; j++)
+    {
+        const uchar *p = gray.constScanLine(j);
+        quint32 *ii = integral_image + (j+1)*stride;
+        quint64 *ii_power = integral_image_power + (j+1)*stride;
+        quint32 rs = 0;
+        quint64 rs_power = 0;
+        ii[0] = 0;
+        ii_power[0] = 0;
+        for (int i=0; i<width; i++)
+        {
+            rs += p[i];
+            rs_power += p[i]*p[i];
+            ii[i+1] = rs;
+            ii_power[i+1] = rs_power;
+        }
+    }
+
+    for (int j=2; j<=height; j++)
+    {
+        quint32 *ii = integral_image + j*stride;
+        const quint32 *ii_prev = ii - stride;
+        quint64 *ii_power = integral_image_power + j*stride;
+        const quint64 *ii_power_prev = ii_power - stride;
+        for (int i=1; i<stride; i++)
+        {
+            ii[i] += ii_prev[i];
+            ii_power[i] += ii_power_prev[i];
+        }
+    }
+}
+
+/*
+*Summary: local adaptive thresholding (Niblack, Sauvola, Bradley-Roth)
+*Parameters:
+*    const QImage &image : input original image
+*    LocalThresholdMethod method : threshold formula, see LocalThresholdMethod
+*    int window_size : side of the square window around each pixel (odd)
+*    float k : the method's parameter
+*Return:
+*    Format_Grayscale8 image, 255 where the luma is above the local threshold and 0 elsewhere
+*Describtion:
+*    The local mean m and standard deviation s come from O(1) box queries into the exact integral
+*    images of the luma (shared through the artifact cache), so the cost does not depend on the window
+*    size. Windows are clipped at the image border and divided by the clipped area.
+*    Rows are thresholded in parallel.
+*/
+
+QImage localThreshold(const QImage &image, LocalThresholdMethod method, int window_size, float k)
+{
+    QImage gray = ArtifactCache::instance().grayImage(image);
+    int width = gray.width();
+    int height = gray.height();
+    int stride = width + 1;
+    int half = window_size / 2;
+
+    QByteArray integrals = ArtifactCache::instance().exactIntegralImages(image);
+    const quint64 *ii_power = (const quint64 *)integrals.constData();
+    const quint32 *ii = (const quint32 *)(ii_power + stride*(height+1));
+
+    QImage newImage(width, height, QImage::Format_Grayscale8);
+
+#pragma omp parallel for
+    for (int j=0; j<height; j++)
+    {
+        int y0 = qMax(j-half, 0);
+        int y1 = qMin(j+half+1, height);
+        const quint32 *s0 = ii + y0*stride;
+        const quint32 *s1 = ii + y1*stride;
+        const quint64 *q0 = ii_power + y0*stride;
+        const quint64 *q1 = ii_power + y1*stride;
+        const uchar *p = gray.constScanLine(j);
+        uchar *dst = newImage.scanLine(j);
+        for (int i=0; i<width; i++)
+        {
+            int x0 = qMax(i-half, 0);
+            int x1 = qMin(i+half+1, width);
+            double area = (double)((x1-x0)*(y1-y0));
+            quint32 sum = s1[x1] - s1[x0] - s0[x1] + s0[x0];
+            double mean = sum / area;
+            double t;
+            if (method == Bradley)
+            {
+                t = mean * (1 - k);
+            }
+            else
+            {
+                quint64 sum_power = q1[x1] - q1[x0] - q0[x1] + q0[x0];
+                double std = sqrt(qMax(sum_power / area - mean*mean, 0.0));
+                if (method == Niblack)
+                    t = mean + k*std;
+                else
+                    t = mean * (1 + k*(std/128 - 1));
+            }
+            dst[i] = p[i] > t ? 255 : 0;
+        }
+    }
+
+    return newImage;
+}
+
+/*
+*Summary: one dimensional squared distance transform of a sampled function
+*Parameters:
+*    const float *f : n samples, 0 on the sites and a huge value elsewhere (or a previous pass)
+*    int n : number of samples
+*    float *d : output min over p of (q-p)^2 + f(p)
+*    int *v : scratch, n ints
+*    float *z : scratch, n+1 floats
+*Describtion:
+*    Felzenszwalb-Huttenlocher: the lower envelope of the parabolas rooted at (p, f(p)) is built in
+*    one sweep (v holds the parabolas, z the boundaries between them) and sampled in a second one.
+*/
+
+static void distanceTransform1D(const float *f, int n, float *d, int *v, float *z)
+{
+    const float inf = 1e20f;
+    int k = 0;
+    v[0] = 0;
+    z[0] = -inf;
+    z[1] = inf;
+    for (int q=1; q<n; q++)
+    {
+        // drop the parabolas hidden by the new one, z[0] = -inf stops the loop
+        float s = ((f[q] + (float)q*q) - (f[v[k]] + (float)v[k]*v[k])) / (2*q - 2*v[k]);
+        while (s <= z[k])
+        {
+            k--;
+            s = ((f[q] + (float)q*q) - (f[v[k]] + (float)v[k]*v[k])) / (2*q - 2*v[k]);
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k+1] = inf;
+    }
+
+    k = 0;
+    for (int q=0; q<n; q++)
+    {
+        while (z[k+1] < q)
+            k++;
+        float dq = (float)(q - v[k]);
+        d[q] = dq*dq + f[v[k]];
+    }
+}
+
+/*
+*Summary: exact euclidean distance transform
+*Parameters:
+*    const QImage &image : input image, non-zero gray values are foreground
+*    float *dist : output width*height distances from every pixel to the nearest background pixel
+*Describtion:
+*    Separable squared distance transform (Felzenszwalb-Huttenlocher): a 1D transform of every
+*    column, then of every row of the result, followed by the square root. Each pass is linear in
+*    the number of pixels whatever the object size, the columns resp. rows are processed in parallel.
+*    The columns go in blocks of 16 that are copied to a scratch strip and back row by row, so the
+*    image is only ever read and written along its rows.
+*    An image without background gets huge distances.
+*/
+
+void distanceTransform(const QImage &image, float *dist)
+{
+    QImage gray = ArtifactCache::instance().grayImage(image);
+    int width = gray.width();
+    int height = gray.height();
+    int n = qMax(width, height);
+    const float inf = 1e20f;
+    const int block = 16;       // columns per strip, a cache line of floats per row
+    int blocks = (width + block - 1) / block;
+
+#pragma omp parallel
+    {
+        ScratchScope scratch;
+        float *f = scratch.alloc<float>(block*n);    // the strip, one column after the other
+        float *d = scratch.alloc<float>(block*n);
+        float *z = scratch.alloc<float>(n+1);
+        int *v = scratch.alloc<int>(n);
+
+        // columns: 0 on background pixels
+#pragma omp for
+        for (int b=0; b<blocks; b++)
+        {
+            int i0 = b*block;
+            int cols = qMin(block, width-i0);
+            for (int j=0; j<height; j++)
+            {
+                const uchar *p = gray.constScanLine(j) + i0;
+                for (int c=0; c<cols; c++)
+                    f[c*height+j] = p[c] ? inf : 0;
+            }
+            for (int c=0; c<cols; c++)
+                distanceTransform1D(f + c*height, height, d + c*height, v, z);
+            for (int j=0; j<height; j++)
+            {
+                float *row = dist + j*width + i0;
+                for (int c=0; c<cols; c++)
+                    row[c] = d[c*height+j];
+            }
+        }
+
+        // rows of the column distances (the implicit barrier of the loop above separates the passes)
+#pragma omp for
+        for (int j=0; j<height; j++)
+        {
+            float *row = dist + j*width;
+            memcpy(f, row, width*sizeof(float));
+            distanceTransform1D(f, width, d, v, z);
+            for (int i=0; i<width; i++)
+                row[i] = sqrtf(d[i]);
+        }
+    }
+}
+
+/*
+*Summary: distance transform as an image
+*Return:
+*    Format_Grayscale8 image, the distances scaled so that the largest one is 255
+*/
+
+QImage calculateDistanceTransform(QImage &image)
+{
+    int width = image.width();
+    int height = image.height();
+    QByteArray cached = ArtifactCache::instance().distanceTransform(image);
+    const float *dist = (const float *)cached.constData();
+
+    float max_dist = 0;
+    for (int i=0; i<width*height; i++)
+    {
+        if (dist[i] < 1e10f)
+            max_dist = qMax(max_dist, dist[i]);
+    }
+    float scale = max_dist > 0 ? 255 / max_dist : 0;
+
+    QImage newImage(width, height, QImage::Format_Grayscale8);
+#pragma omp parallel for
+    for (int j=0; j<height; j++)
+    {
+        const float *p = dist + j*width;
+        uchar *dst = newImage.scanLine(j);
+        for (int i=0; i<width; i++)
+            dst[i] = (uchar)qMin(255.0f, p[i]*scale + 0.5f);
+    }
+    return newImage;
+}
@@ -13,6 +13,13 @@ enum ImageChannel
     B
 };
 
+enum LocalThresholdMethod
+{
+    Niblack = 0,    // T = m + k*s
+    Sauvola,        // T = m*(1 + k*(s/128 - 1))
+    Bradley         // T = m*(1 - k)
+};
+
 enum ColorMap
 {
     Jet = 0,    // Jet colormap array
@@ -25,10 +32,18 @@ QImage calculateNegative(QImage &image, ImageChannel channel);
 QImage convertToPseudoColor(QImage &image, ColorMap map);
 QImage equalizeHistogramProc(QImage &image);
 QImage equalizeHistogramProc1(QImage &image);
+QImage contrastLimitedEqualization(const QImage &image, int tiles_x, int tiles_y, float clip_limit);
 void paddingZeros(const float *r, const float *g, const float *b,
                    const int width, const int height,
                    const int half_pad_width, const int half_pad_height,
                    float *nr, float *ng, float *nb);
+int imageChannelCount(const QImage &image);
+bool isHighBitDepth(const QImage &image);
+void splitImageChannel(QImage &image, uchar *pixels, int cn);
+void splitImagePlanes(QImage &image, float *planes, int cn);
+void concatenateImageChannel(const uchar *pixels, int w, int h, int cn, QImage &image);
+void concatenateImagePlanes(const float *planes, int w, int h, int cn, bool deep, QImage &image);
+void grayMorphology(const QImage &src_image, const int *kernel, int size_kernel, bool dilate, QImage &dst_image);
 void splitImageChannel(QImage &image, uchar *r, uchar *g, uchar *b);
 void splitImageChannel(QImage &image, uchar *rgb);
 void splitImageChannel(QImage &image, float *r, float *g, float *b);
@@ -38,11 +53,17 @@ void concatenateImageChannel(float *rgb, int w, int h, QImage &image);
 void concatenateImageChannel(uchar *r, uchar *g, uchar *b, int w, int h, QImage &image);
 void concatenateImageChannel(uchar *rgb, int w, int h, QImage &image);
 void rgb2ycrcb(uchar *r, uchar *g, uchar *b, int size, float *y, float *cr, float *cb);
+void rgb2ycrcb(const float *r, const float *g, const float *b, int size, float *y, float *cr, float *cb);
 void ycrcb2rgb(float *y, float *cr, float *cb, int size, uchar *r, uchar *g, uchar *b);
+void ycrcb2rgb(const float *y, const float *cr, const float *cb, int size, float *r, float *g, float *b);
 void calculate_integral_image(float *image, int width, int height, float *integral_image);
 void calculate_integral_image_power(float *image, int width, int height, float *integral_image);
-__inline float box_integral(float *integral_image, int width, int height, int c1, int c2, int r1, int r2);
-void adaptiveContrastEnhancement(QImage &src_image, float *rgb, float *rgb_ii, float *rgb_ii_power, int max_window_size,
+void calculate_exact_integral_images(const QImage &gray, quint32 *integral_image, quint64 *integral_image_power);
+void distanceTransform(const QImage &image, float *dist);
+QImage calculateDistanceTransform(QImage &image);
+QImage localThreshold(const QImage &image, LocalThresholdMethod method, int window_size, float k);
+__inline float box_integral(const float *integral_image, int width, int height, int c1, int c2, int r1, int r2);
+void adaptiveContrastEnhancement(QImage &src_image, int cn, const float *rgb, const float *rgb_ii, const float *rgb_ii_power,
                                  int half_window_size, float alpha, float max_cg, QImage &dst_image);
 
 const uchar hot_table[]={
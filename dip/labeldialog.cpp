@@ -0,0 +1,104 @@
+#include "labeldialog.h"
+#include <QHeaderView>
+
+LabelDialog::LabelDialog(QImage inputImage)
+{
+    srcImage = inputImage;
+
+    labels = dialogScratch.alloc<int>(srcImage.width()*srcImage.height());
+    count = labelConnectedComponents(srcImage, labels, stats);
+    dstImage = labelsToPseudoColor(labels, srcImage.width(), srcImage.height(), colorMap);
+
+    iniUI();
+    fillStatsTable();
+
+    srcImageLabel->setPixmap(QPixmap::fromImage(srcImage));
+    dstImageLabel->setPixmap(QPixmap::fromImage(dstImage));
+}
+
+void LabelDialog::iniUI()
+{
+    // two image labels
+    srcImageLabel = new QLabel();
+    srcImageLabel->setAlignment(Qt::AlignCenter);
+    dstImageLabel = new QLabel();
+    dstImageLabel->setAlignment(Qt::AlignCenter);
+
+    // colormap of the label image
+    colorMapLabel = new QLabel(tr("Color Map"));
+    colorMapLabel->setAlignment(Qt::AlignRight);
+    colorMapComboBox = new QComboBox;
+    colorMapComboBox->addItem(tr("Jet"));
+    colorMapComboBox->addItem(tr("Parula"));
+    colorMapComboBox->addItem(tr("Hot"));
+    colorMapComboBox->setCurrentIndex(colorMap);
+    connect(colorMapComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(updateDstImage(int)));
+
+    countLabel = new QLabel(tr("%1 components").arg(count));
+
+    // one row per component
+    statsTable = new QTableWidget(0, 6);
+    statsTable->setHorizontalHeaderLabels(QStringList() << tr("Label") << tr("Area") << tr("Bounding Box")
+                                          << tr("Centroid X") << tr("Centroid Y") << tr("Mean Intensity"));
+    statsTable->verticalHeader()->setVisible(false);
+    statsTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    statsTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+
+    // three buttons
+    btnOK = new QPushButton(tr("OK"));
+    btnCancel = new QPushButton(tr("Cancel"));
+    btnClose = new QPushButton(tr("Exit"));
+
+    connect(btnOK, SIGNAL(clicked()), this, SLOT(accept()));
+    connect(btnCancel, SIGNAL(clicked()), this, SLOT(reject()));
+    connect(btnClose, SIGNAL(clicked()), this, SLOT(close()));
+
+    QHBoxLayout *layout1 = new QHBoxLayout;
+    layout1->addWidget(srcImageLabel);
+    layout1->addWidget(dstImageLabel);
+
+    QHBoxLayout *layout2 = new QHBoxLayout;
+    layout2->addWidget(countLabel);
+    layout2->addStretch();
+    layout2->addWidget(colorMapLabel);
+    layout2->addWidget(colorMapComboBox);
+
+    QHBoxLayout *layout3=new QHBoxLayout;
+    layout3->addStretch();
+    layout3->addWidget(btnOK);
+    layout3->addWidget(btnCancel);
+    layout3->addStretch();
+    layout3->addWidget(btnClose);
+
+    // main layout
+    QVBoxLayout *mainlayout = new QVBoxLayout;
+    mainlayout->addLayout(layout1, 6);
+    mainlayout->addLayout(layout2, 1);
+    mainlayout->addWidget(statsTable, 3);
+    mainlayout->addLayout(layout3, 1);
+    setLayout(mainlayout);
+}
+
+void LabelDialog::fillStatsTable()
+{
+    statsTable->setRowCount(count);
+    for (int i=0; i<count; i++)
+    {
+        const ComponentStats &s = stats[i];
+        const QRect &r = s.boundingBox;
+        statsTable->setItem(i, 0, new QTableWidgetItem(QString::number(i+1)));
+        statsTable->setItem(i, 1, new QTableWidgetItem(QString::number(s.area)));
+        statsTable->setItem(i, 2, new QTableWidgetItem(QString("(%1, %2) %3x%4")
+                                                       .arg(r.x()).arg(r.y()).arg(r.width()).arg(r.height())));
+        statsTable->setItem(i, 3, new QTableWidgetItem(QString::number(s.centroid.x(), 'f', 1)));
+        statsTable->setItem(i, 4, new QTableWidgetItem(QString::number(s.centroid.y(), 'f', 1)));
+        statsTable->setItem(i, 5, new QTableWidgetItem(QString::number(s.meanIntensity, 'f', 1)));
+    }
+}
+
+void LabelDialog::updateDstImage(int index)
+{
+    colorMap = (ColorMap)index;
+    dstImage = labelsToPseudoColor(labels, srcImage.width(), srcImage.height(), colorMap);
+    dstImageLabel->setPixmap(QPixmap::fromImage(dstImage));
+}
@@ -0,0 +1,62 @@
+#ifndef LABELDIALOG_H
+#define LABELDIALOG_H
+
+#include <QDialog>
+#include <QLabel>
+#include <QComboBox>
+#include <QTableWidget>
+#include <QBoxLayout>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QPushButton>
+#include <QImage>
+#include <QVector>
+#include "imageprocess.h"
+#include "labeling.h"
+#include "scratcharena.h"
+
+QT_BEGIN_NAMESPACE
+class QLabel;
+class QComboBox;
+class QTableWidget;
+class QPushButton;
+class QBoxLayout;
+class QHBoxLayout;
+class QVBoxLayout;
+QT_END_NAMESPACE
+
+class LabelDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    LabelDialog(QImage inputImage);
+    QImage getImage() {return dstImage;}
+private:
+    void iniUI();
+    void fillStatsTable();
+    QImage srcImage;
+    QImage dstImage;
+    QLabel *srcImageLabel;
+    QLabel *dstImageLabel;
+
+    ScratchScope dialogScratch;     // buffers that live as long as the dialog
+    int *labels = nullptr;
+    int count = 0;
+    QVector<ComponentStats> stats;
+
+    QLabel *colorMapLabel;
+    QComboBox *colorMapComboBox;
+    QLabel *countLabel;
+    QTableWidget *statsTable;
+
+    QPushButton     *btnOK;
+    QPushButton     *btnCancel;
+    QPushButton     *btnClose;
+
+    ColorMap colorMap = Jet;
+
+private slots:
+    void updateDstImage(int index);
+};
+
+#endif // LABELDIALOG_H
@@ -0,0 +1,276 @@
+#include "labeling.h"
+#include "artifactcache.h"
+#include "scratcharena.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// union-find over provisional labels, a root is its own parent and every other label points to a smaller one
+static int findRoot(int *parent, int x)
+{
+    int root = x;
+    while (parent[root] < root)
+        root = parent[root];
+    while (parent[x] > root)
+    {
+        int next = parent[x];
+        parent[x] = root;
+        x = next;
+    }
+    return root;
+}
+
+static int mergeSets(int *parent, int a, int b)
+{
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if (a < b)
+    {
+        parent[b] = a;
+        return a;
+    }
+    parent[a] = b;
+    return b;
+}
+
+// per provisional label sums, reduced to the components' ComponentStats at the end
+struct ComponentSums
+{
+    qint64 area;
+    qint64 sum_x;
+    qint64 sum_y;
+    qint64 sum_intensity;
+    int x0, y0, x1, y1;
+};
+
+static inline void addPixel(ComponentSums &s, int x, int y, int intensity)
+{
+    if (s.area == 0)
+    {
+        s.x0 = s.x1 = x;
+        s.y0 = s.y1 = y;
+    }
+    s.area++;
+    s.sum_x += x;
+    s.sum_y += y;
+    s.sum_intensity += intensity;
+    s.x0 = qMin(s.x0, x);
+    s.x1 = qMax(s.x1, x);
+    s.y0 = qMin(s.y0, y);
+    s.y1 = qMax(s.y1, y);
+}
+
+/*
+*Summary: 8-connected component labeling with per-component statistics
+*Parameters:
+*    const QImage &image : input image, non-zero gray values are foreground
+*    int *labels : output width*height labels, 0 for background and 1 .. count for the components
+*    QVector<ComponentStats> &stats : output statistics, stats[label-1] belongs to label
+*Return:
+*    number of components
+*Describtion:
+*    (1) The image is scanned in 2x2 blocks (block based union-find as in BBDT): all foreground
+*        pixels of a block are 8-connected, so one provisional label per block is enough and only
+*        the blocks above-left, above, above-right and left are tested, each by the few pixels
+*        that can touch the current block. The block rows are split into one band per thread,
+*        every band uses its own label range, so the bands are labeled in parallel. Area, sums of
+*        coordinates and intensities and the bounding box are accumulated per provisional label
+*        in the same scan.
+*    (2) The first block row of each band is merged with the last one of the band above.
+*    (3) The label equivalences are flattened to consecutive labels and the sums are reduced.
+*    (4) Every pixel takes the final label of its block, rows in parallel.
+*/
+
+int labelConnectedComponents(const QImage &image, int *labels, QVector<ComponentStats> &stats)
+{
+    QImage gray = ArtifactCache::instance().grayImage(image);
+    int width = gray.width();
+    int height = gray.height();
+    int bw = (width + 1) / 2;
+    int bh = (height + 1) / 2;
+
+    int bands = 1;
+#ifdef _OPENMP
+    bands = qBound(1, omp_get_max_threads(), qMax(bh, 1));
+#endif
+    int band_rows = (bh + bands - 1) / qMax(bands, 1);
+
+    // union-find needs the whole image, the tables are borrowed in one piece and count against the budget
+    ScratchScope scratch("labelConnectedComponents");
+    int *block = scratch.alloc<int>(bw*bh);
+    int *parent = scratch.alloc<int>(bw*bh+1);
+    int *band_end = scratch.alloc<int>(bands);
+    ComponentSums *sums = scratch.alloc<ComponentSums>(bw*bh+1);
+    memset(sums, 0, (bw*bh+1)*sizeof(ComponentSums));
+
+    // foreground test with the image border treated as background
+#define FG(x, y) ((unsigned)(x) < (unsigned)width && (unsigned)(y) < (unsigned)height && gray.constScanLine(y)[x] != 0)
+
+    // (1) label the bands independently
+#pragma omp parallel for
+    for (int band=0; band<bands; band++)
+    {
+        int by0 = band*band_rows;
+        int by1 = qMin(by0 + band_rows, bh);
+        int next = by0*bw + 1;      // label range of the band, no band has more blocks than that
+        for (int by=by0; by<by1; by++)
+        {
+            int y = 2*by;
+            for (int bx=0; bx<bw; bx++)
+            {
+                int x = 2*bx;
+                bool a = FG(x, y), b = FG(x+1, y), c = FG(x, y+1), d = FG(x+1, y+1);
+                if (!(a || b || c || d))
+                {
+                    block[by*bw+bx] = 0;
+                    continue;
+                }
+
+                int label = 0;
+                int other;
+                if (by > by0)
+                {
+                    const int *above = block + (by-1)*bw;
+                    if (bx > 0 && a && FG(x-1, y-1) && (other = above[bx-1]))
+                        label = other;
+                    if ((a || b) && (FG(x, y-1) || FG(x+1, y-1)) && (other = above[bx]))
+                        label = label ? mergeSets(parent, label, other) : other;
+                    if (bx+1 < bw && b && FG(x+2, y-1) && (other = above[bx+1]))
+                        label = label ? mergeSets(parent, label, other) : other;
+                }
+                if (bx > 0 && (a || c) && (FG(x-1, y) || FG(x-1, y+1)) && (other = block[by*bw+bx-1]))
+                    label = label ? mergeSets(parent, label, other) : other;
+                if (!label)
+                {
+                    label = next++;
+                    parent[label] = label;
+                }
+                block[by*bw+bx] = label;
+
+                ComponentSums &s = sums[label];
+                if (a) addPixel(s, x, y, gray.constScanLine(y)[x]);
+                if (b) addPixel(s, x+1, y, gray.constScanLine(y)[x+1]);
+                if (c) addPixel(s, x, y+1, gray.constScanLine(y+1)[x]);
+                if (d) addPixel(s, x+1, y+1, gray.constScanLine(y+1)[x+1]);
+            }
+        }
+        band_end[band] = next;
+    }
+
+    // (2) merge the bands at their borders
+    for (int band=1; band<bands; band++)
+    {
+        int by = band*band_rows;
+        if (by >= bh)
+            break;
+        int y = 2*by;
+        const int *above = block + (by-1)*bw;
+        const int *current = block + by*bw;
+        for (int bx=0; bx<bw; bx++)
+        {
+            if (!current[bx])
+                continue;
+            int x = 2*bx;
+            bool a = FG(x, y), b = FG(x+1, y);
+            if (bx > 0 && a && FG(x-1, y-1) && above[bx-1])
+                mergeSets(parent, current[bx], above[bx-1]);
+            if ((a || b) && (FG(x, y-1) || FG(x+1, y-1)) && above[bx])
+                mergeSets(parent, current[bx], above[bx]);
+            if (bx+1 < bw && b && FG(x+2, y-1) && above[bx+1])
+                mergeSets(parent, current[bx], above[bx+1]);
+        }
+    }
+#undef FG
+
+    // (3) consecutive final labels, a label's parent is smaller and already final
+    int count = 0;
+    for (int band=0; band<bands; band++)
+    {
+        for (int l=band*band_rows*bw+1; l<band_end[band]; l++)
+            parent[l] = parent[l] < l ? parent[parent[l]] : ++count;
+    }
+
+    QVector<ComponentSums> total(count);
+    memset(total.data(), 0, count*sizeof(ComponentSums));
+    for (int band=0; band<bands; band++)
+    {
+        for (int l=band*band_rows*bw+1; l<band_end[band]; l++)
+        {
+            const ComponentSums &s = sums[l];
+            if (s.area == 0)
+                continue;
+            ComponentSums &t = total[parent[l]-1];
+            t.x0 = t.area ? qMin(t.x0, s.x0) : s.x0;
+            t.y0 = t.area ? qMin(t.y0, s.y0) : s.y0;
+            t.x1 = t.area ? qMax(t.x1, s.x1) : s.x1;
+            t.y1 = t.area ? qMax(t.y1, s.y1) : s.y1;
+            t.area += s.area;
+            t.sum_x += s.sum_x;
+            t.sum_y += s.sum_y;
+            t.sum_intensity += s.sum_intensity;
+        }
+    }
+
+    stats.resize(count);
+    for (int i=0; i<count; i++)
+    {
+        const ComponentSums &t = total[i];
+        stats[i].area = (int)t.area;
+        stats[i].boundingBox = QRect(QPoint(t.x0, t.y0), QPoint(t.x1, t.y1));
+        stats[i].centroid = QPointF((double)t.sum_x / t.area, (double)t.sum_y / t.area);
+        stats[i].meanIntensity = (double)t.sum_intensity / t.area;
+    }
+
+    // (4) final label of every pixel
+#pragma omp parallel for
+    for (int y=0; y<height; y++)
+    {
+        const uchar *p = gray.constScanLine(y);
+        const int *blocks = block + (y/2)*bw;
+        int *dst = labels + y*width;
+        for (int x=0; x<width; x++)
+            dst[x] = p[x] ? parent[blocks[x/2]] : 0;
+    }
+
+    return count;
+}
+
+/*
+*Summary: show a label image with one of the pseudo-color maps
+*Parameters:
+*    const int *labels : width*height labels, 0 is background
+*    int width : image width
+*    int height : image height
+*    ColorMap map : colormap, see convertToPseudoColor()
+*Return:
+*    Format_RGB888 image, the background is black
+*Describtion:
+*    Labels are scattered over the colormap so that neighbouring labels get distinct colors.
+*/
+
+QImage labelsToPseudoColor(const int *labels, int width, int height, ColorMap map)
+{
+    QImage index(width, height, QImage::Format_Grayscale8);
+#pragma omp parallel for
+    for (int y=0; y<height; y++)
+    {
+        const int *l = labels + y*width;
+        uchar *dst = index.scanLine(y);
+        for (int x=0; x<width; x++)
+            dst[x] = (uchar)(l[x] ? 1 + (l[x]*67) % 255 : 0);
+    }
+
+    QImage newImage = convertToPseudoColor(index, map);
+#pragma omp parallel for
+    for (int y=0; y<height; y++)
+    {
+        const int *l = labels + y*width;
+        uchar *dst = newImage.scanLine(y);
+        for (int x=0; x<width; x++)
+        {
+            if (!l[x])
+                dst[3*x] = dst[3*x+1] = dst[3*x+2] = 0;
+        }
+    }
+    return newImage;
+}
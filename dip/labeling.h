@@ -0,0 +1,22 @@
+#ifndef LABELING_H
+#define LABELING_H
+
+#include <QImage>
+#include <QRect>
+#include <QPointF>
+#include <QVector>
+#include "imageprocess.h"
+
+// measurements of one connected component, stats[label-1] belongs to label
+struct ComponentStats
+{
+    int area;               // number of pixels
+    QRect boundingBox;
+    QPointF centroid;
+    double meanIntensity;   // mean gray value of the component's pixels
+};
+
+int labelConnectedComponents(const QImage &image, int *labels, QVector<ComponentStats> &stats);
+QImage labelsToPseudoColor(const int *labels, int width, int height, ColorMap map);
+
+#endif // LABELING_H
@@ -49,9 +49,12 @@
 ****************************************************************************/
 
 #include <QtWidgets>
+#include <QtConcurrent>
 
 #include "mainwindow.h"
 #include "mdichild.h"
+#include "artifactcache.h"
+#include "scratcharena.h"
 
 MainWindow::MainWindow()
     : mdiArea(new QMdiArea)
@@ -96,6 +99,8 @@ void MainWindow::closeEvent(QCloseEvent *event)
         event->ignore();
     } else {
         writeSettings();
+        if (ScratchArena::peakLogging())
+            ScratchArena::logOperationPeaks();
         event->accept();
     }
 }
@@ -161,6 +166,8 @@ bool MainWindow::openFile(const QString &fileName)
                 this, &MainWindow::closeMdiChildView);
         connect(child, &MdiChild::imageChanged,
                 this, &MainWindow::updateMdiChildView);
+        connect(child, &MdiChild::imageChanged,
+                this, &MainWindow::updateMenus);
     }
     else
         child->close();
@@ -266,6 +273,20 @@ void MainWindow::saveAs()
     }
 }
 
+void MainWindow::undo()
+{
+    MdiChild *child = activeMdiChild();
+    if (child && child->undo())
+        statusBar()->showMessage(tr("Undo"), 2000);
+}
+
+void MainWindow::redo()
+{
+    MdiChild *child = activeMdiChild();
+    if (child && child->redo())
+        statusBar()->showMessage(tr("Redo"), 2000);
+}
+
 #ifndef QT_NO_CLIPBOARD
 void MainWindow::copy()
 {
@@ -286,6 +307,8 @@ void MainWindow::paste()
                 this, &MainWindow::closeMdiChildView);
         connect(child, &MdiChild::imageChanged,
                 this, &MainWindow::updateMdiChildView);
+        connect(child, &MdiChild::imageChanged,
+                this, &MainWindow::updateMenus);
     }
 }
 #endif
@@ -300,6 +323,8 @@ void MainWindow::updateMenus()
 {
     bool hasMdiChild = (activeMdiChild() != 0);
     saveAct->setEnabled(hasMdiChild);
+    undoAct->setEnabled(hasMdiChild && activeMdiChild()->canUndo());
+    redoAct->setEnabled(hasMdiChild && activeMdiChild()->canRedo());
     saveAsAct->setEnabled(hasMdiChild);
 #ifndef QT_NO_CLIPBOARD
     pasteAct->setEnabled(hasMdiChild);
@@ -364,6 +389,8 @@ void MainWindow::updateWindowMenu()
 MdiChild *MainWindow::createMdiChild()
 {
     MdiChild *child = new MdiChild();
+    child->history.setMemoryBudget(historyBudget);
+    child->history.setCompression(historyCompression);
     mdiArea->addSubWindow(child);
 
 #ifndef QT_NO_CLIPBOARD
@@ -435,10 +462,24 @@ void MainWindow::createActions()
     fileMenu->addAction(exitAct);
 //! [0]
 
-#ifndef QT_NO_CLIPBOARD
     editMenu = menuBar()->addMenu(tr("&Edit"));
     editToolBar = addToolBar(tr("Edit"));
 
+    undoAct = new QAction(tr("&Undo"), this);
+    undoAct->setShortcuts(QKeySequence::Undo);
+    undoAct->setStatusTip(tr("Undo the last operation"));
+    connect(undoAct, &QAction::triggered, this, &MainWindow::undo);
+    editMenu->addAction(undoAct);
+
+    redoAct = new QAction(tr("&Redo"), this);
+    redoAct->setShortcuts(QKeySequence::Redo);
+    redoAct->setStatusTip(tr("Redo the last undone operation"));
+    connect(redoAct, &QAction::triggered, this, &MainWindow::redo);
+    editMenu->addAction(redoAct);
+    editMenu->addSeparator();
+
+#ifndef QT_NO_CLIPBOARD
+
     const QIcon copyIcon = QIcon::fromTheme("edit-copy", QIcon(":/images/copy.png"));
     copyAct = new QAction(copyIcon, tr("&Copy"), this);
     copyAct->setShortcuts(QKeySequence::Copy);
@@ -533,6 +574,7 @@ void MainWindow::createActions()
     */
     grayViewAct = viewMenu->addAction(tr("Gray Image"), this, &MainWindow::createMdiChildView);
     spectrumViewAct = viewMenu->addAction(tr("Spectrum"), this, &MainWindow::createMdiChildView);
+    distanceViewAct = viewMenu->addAction(tr("Distance Transform"), this, &MainWindow::createMdiChildView);
     histViewMenu = viewMenu->addMenu(tr("Histogram"));
     histViewYAct = histViewMenu->addAction(tr("Y"), this, &MainWindow::createMdiChildView);
     histViewRAct = histViewMenu->addAction(tr("R"), this, &MainWindow::createMdiChildView);
@@ -570,16 +612,20 @@ void MainWindow::createActions()
     convertGrayImageAct = enhancementMenu->addAction(tr("Gray Image"), this, &MainWindow::convertGrayImage);
     equalizeHistogramAct = enhancementMenu->addAction(tr("Hist Equalization"), this, &MainWindow::equalizeHistogram);
     adaptiveContrastEnhancementAct = enhancementMenu->addAction(tr("Adaptive Contrast Equalization"), this, &MainWindow::adaptiveContrastEnhancement);
+    claheAct = enhancementMenu->addAction(tr("CLAHE"), this, &MainWindow::contrastLimitedEqualize);
 
     menuBar()->addSeparator();
     filterMenu = menuBar()->addMenu(tr("&Filter"));
     timeDomainAct = filterMenu->addAction(tr("Space Domain"), this, &MainWindow::spaceDomainFiltering);
     frequencyDomainAct = filterMenu->addAction(tr("Frequency Domain"), this, &MainWindow::frequencyDomainFiltering);
     embossFilterAct = filterMenu->addAction(tr("Emboss Filter"), this, &MainWindow::embossFiltering);
+    gaussianBlurAct = filterMenu->addAction(tr("Gaussian Blur"), this, &MainWindow::gaussianFiltering);
+    medianFilterAct = filterMenu->addAction(tr("Median Filter"), this, &MainWindow::medianFiltering);
 
     menuBar()->addSeparator();
     segmentMenu = menuBar()->addMenu(tr("&Segmentation"));
     thresholdAct = segmentMenu->addAction(tr("threshold segment"), this, &MainWindow::thresholdSegment);
+    labelAct = segmentMenu->addAction(tr("Connected Components"), this, &MainWindow::labelComponents);
 
     menuBar()->addSeparator();
     morphologyMenu = menuBar()->addMenu(tr("&Morphology"));
@@ -627,12 +673,30 @@ void MainWindow::readSettings()
     } else {
         restoreGeometry(geometry);
     }
+
+    // undo history memory budget per image (MB)
+    historyBudget = settings.value("historyBudget", 512).toLongLong() * 1024 * 1024;
+    historyCompression = settings.value("historyCompression", false).toBool();
+
+    // derived artifact cache shared by all images (MB)
+    int artifactCacheSize = settings.value("artifactCacheSize", 256).toInt();
+    ArtifactCache::instance().setMaxCost(artifactCacheSize * 1024);
+
+    // scratch memory budget of the image operations (MB), 0 for no limit
+    ScratchArena::setBudget(settings.value("memoryBudget", 2048).toLongLong() * 1024 * 1024);
+    // per operation scratch memory peaks in the debug log
+    ScratchArena::setPeakLogging(settings.value("memoryPeakLog", false).toBool());
 }
 
 void MainWindow::writeSettings()
 {
     QSettings settings(QCoreApplication::organizationName(), QCoreApplication::applicationName());
     settings.setValue("geometry", saveGeometry());
+    settings.setValue("historyBudget", historyBudget / (1024 * 1024));
+    settings.setValue("historyCompression", historyCompression);
+    settings.setValue("artifactCacheSize", ArtifactCache::instance().maxCost() / 1024);
+    settings.setValue("memoryBudget", ScratchArena::budget() / (1024 * 1024));
+    settings.setValue("memoryPeakLog", ScratchArena::peakLogging());
 }
 
 MdiChild *MainWindow::activeMdiChild() const
@@ -767,6 +831,10 @@ QString MainWindow::getMdiChildViewLabel(QObject *sender)
         label = "spectrum";
     }
 
+    if (sender == distanceViewAct) {
+        label = "distance";
+    }
+
     if (sender == histViewYAct) {
         label = "histY";
     }
@@ -810,13 +878,17 @@ QImage MainWindow::getMdiChildViewImage(QImage ownerImage, QString label)
     QImage image;
 
     if (label == "gray") {
-        image = ownerImage.convertToFormat(QImage::Format_Grayscale8);
+        image = ArtifactCache::instance().grayImage(ownerImage);
     }
 
     if (label == "spectrum") {
         calcImageSpectrum(ownerImage, image);
     }
 
+    if (label == "distance") {
+        image = calculateDistanceTransform(ownerImage);
+    }
+
     if (label == "histY") {
         image = calculateHistogram(ownerImage, ImageChannel::Y);
     }
@@ -875,6 +947,10 @@ void MainWindow::createMdiChildView()
         viewChild->setCurrentFile(fileName);
         viewChild->loadFromImage(image);
         viewChild->setLabel(label);
+        connect(viewChild, &MdiChild::viewRefreshRequested,
+                this, &MainWindow::refreshMdiChildView);
+        connect(&viewChild->viewWatcher, &QFutureWatcher<QImage>::finished,
+                viewChild, [this, viewChild]() { finishMdiChildViewRefresh(viewChild); });
 
         mdiArea->addSubWindow(viewChild);
         initMdiSubWindow((MdiChild*)viewChild);
@@ -893,16 +969,59 @@ QMdiSubWindow *MainWindow::findMdiViewChild(MdiChild *owner, const QString &file
 
 void MainWindow::updateMdiChildView()
 {
+    // only mark the views, they are recomputed once they are painted again
     foreach (QMdiSubWindow *window, mdiArea->subWindowList()) {
         MdiChild *mdiChild = qobject_cast<MdiChild *>(window->widget());
         MdiChild *owner = ((MdiChild*)mdiChild->owner);
-        if (owner == sender()) {
-            QString label = mdiChild->label;
-            QImage ownerImage = owner->image;
-            QImage image = getMdiChildViewImage(ownerImage, label);
-            mdiChild->setImage(image);
-        }
+        if (owner == sender())
+            mdiChild->markViewDirty();
+    }
+}
+
+/*
+*Summary: recompute a derived view in the background
+*Describtion:
+*    The view image is computed from a copy of the owner image in a worker thread.
+*    A view has at most one refresh in flight: requests that arrive meanwhile only set a
+*    flag and one more refresh of the then current owner image starts when it finishes,
+*    so a burst of edits costs two computations instead of one per edit.
+*    The result is only shown if the owner has not changed in the meantime.
+*/
+
+void MainWindow::refreshMdiChildView()
+{
+    MdiChild *viewChild = qobject_cast<MdiChild *>(sender());
+    if (viewChild)
+        startMdiChildViewRefresh(viewChild);
+}
+
+void MainWindow::startMdiChildViewRefresh(MdiChild *viewChild)
+{
+    MdiChild *owner = qobject_cast<MdiChild *>(viewChild->owner);
+    if (!owner)
+        return;
+    if (viewChild->viewWatcher.isRunning())
+    {
+        viewChild->viewRefreshQueued = true;
+        return;
+    }
+
+    viewChild->viewRefreshQueued = false;
+    viewChild->viewVersion = owner->imageVersion();
+    viewChild->viewWatcher.setFuture(QtConcurrent::run(this, &MainWindow::getMdiChildViewImage,
+                                                       owner->image, viewChild->label));
+}
+
+void MainWindow::finishMdiChildViewRefresh(MdiChild *viewChild)
+{
+    if (viewChild->viewRefreshQueued)
+    {
+        startMdiChildViewRefresh(viewChild);
+        return;
     }
+    MdiChild *owner = qobject_cast<MdiChild *>(viewChild->owner);
+    if (owner && owner->imageVersion() == viewChild->viewVersion)
+        viewChild->setImage(viewChild->viewWatcher.result());
 }
 
 void MainWindow::closeMdiChildView()
@@ -959,6 +1078,24 @@ void MainWindow::adaptiveContrastEnhancement()
     }
 }
 
+void MainWindow::contrastLimitedEqualize()
+{
+    MdiChild * owner = activeMdiChild();
+    if (owner) {
+        QImage image = owner->image;
+
+        ClaheDialog *d = new ClaheDialog(image);
+        int ret = d->exec () ; // modal dialog
+        if (ret == QDialog::Accepted)
+        {
+            QImage newImage = d->getImage();
+            owner->setImage(newImage);
+        }
+
+        delete d;
+    }
+}
+
 void MainWindow::spaceDomainFiltering()
 {
     MdiChild * owner = activeMdiChild();
@@ -1018,6 +1155,44 @@ void MainWindow::embossFiltering()
     }
 }
 
+void MainWindow::gaussianFiltering()
+{
+    MdiChild * owner = activeMdiChild();
+    if (owner) {
+        QImage image = owner->image;
+
+        GaussianBlurDialog *d = new GaussianBlurDialog(image);
+        d->setWindowTitle(tr("Gaussian Blur"));
+        int ret = d->exec () ; // modal dialog
+        if (ret == QDialog::Accepted)
+        {
+            QImage newImage = d->getImage();
+            owner->setImage(newImage);
+        }
+
+        delete d;
+    }
+}
+
+void MainWindow::medianFiltering()
+{
+    MdiChild * owner = activeMdiChild();
+    if (owner) {
+        QImage image = owner->image;
+
+        MedianFilterDialog *d = new MedianFilterDialog(image);
+        d->setWindowTitle(tr("Median Filter"));
+        int ret = d->exec () ; // modal dialog
+        if (ret == QDialog::Accepted)
+        {
+            QImage newImage = d->getImage();
+            owner->setImage(newImage);
+        }
+
+        delete d;
+    }
+}
+
 
 void MainWindow::erodeOperation()
 {
@@ -1117,6 +1292,25 @@ void MainWindow::thresholdSegment()
     }
 }
 
+void MainWindow::labelComponents()
+{
+    MdiChild * owner = activeMdiChild();
+    if (owner) {
+        QImage image = owner->image;
+
+        LabelDialog *d = new LabelDialog(image);
+        d->setWindowTitle(tr("Connected Components"));
+        int ret = d->exec () ; // modal dialog
+        if (ret == QDialog::Accepted)
+        {
+            QImage newImage = d->getImage();
+            owner->setImage(newImage);
+        }
+
+        delete d;
+    }
+}
+
 void MainWindow::switchLanguage()
 {
     QString languageFile;
@@ -1155,6 +1349,12 @@ void MainWindow::retranslate()
     editMenu->setTitle(tr("&Edit"));
     //editToolBar = addToolBar(tr("Edit"));
 
+    undoAct->setText(tr("&Undo"));
+    undoAct->setStatusTip(tr("Undo the last operation"));
+
+    redoAct->setText(tr("&Redo"));
+    redoAct->setStatusTip(tr("Redo the last undone operation"));
+
     copyAct->setText(tr("&Copy"));
     copyAct->setStatusTip(tr("Copy the current selection's contents to the "
                              "clipboard"));
@@ -1196,6 +1396,7 @@ void MainWindow::retranslate()
     fitToWindowAct->setShortcut(tr("Ctrl+F"));
     grayViewAct->setText(tr("Gray Image"));
     spectrumViewAct->setText(tr("Spectrum"));
+    distanceViewAct->setText(tr("Distance Transform"));
 
     histViewMenu->setTitle(tr("Histogram"));
     histViewYAct->setText(tr("Y"));
@@ -1218,15 +1419,19 @@ void MainWindow::retranslate()
     convertGrayImageAct->setText(tr("Gray Image"));
     equalizeHistogramAct->setText(tr("Hist Equalization"));
     adaptiveContrastEnhancementAct->setText(tr("Adaptive Contrast Equalization"));
+    claheAct->setText(tr("CLAHE"));
 
     filterMenu->setTitle(tr("&Filter"));
     timeDomainAct->setText(tr("Space Domain"));
     frequencyDomainAct->setText(tr("Frequency Domain"));
     embossFilterAct->setText(tr("Emboss Filter"));
+    gaussianBlurAct->setText(tr("Gaussian Blur"));
+    medianFilterAct->setText(tr("Median Filter"));
 
 
     segmentMenu->setTitle(tr("&Segmentation"));
     thresholdAct->setText(tr("threshold segment"));
+    labelAct->setText(tr("Connected Components"));
 
     morphologyMenu->setTitle(tr("&Morphology"));
     erodeAct->setText(tr("Erode"));
@@ -57,6 +57,9 @@
 #include <mdichild.h>
 #include "imageprocess.h"
 #include "acedialog.h"
+#include "clahedialog.h"
+#include "gaussianblurdialog.h"
+#include "medianfilterdialog.h"
 #include "fdfilterdialog.h"
 #include "sdfilterdialog.h"
 #include "embossfilterdialog.h"
@@ -66,6 +69,7 @@
 #include "opendialog.h"
 #include "closedialog.h"
 #include "thresholddialog.h"
+#include "labeldialog.h"
 
 //class MdiChild;
 //class MdiViewChild;
@@ -94,6 +98,8 @@ private slots:
     void saveAs();
     void updateRecentFileActions();
     void openRecentFile();
+    void undo();
+    void redo();
 #ifndef QT_NO_CLIPBOARD
     void copy();
     void paste();
@@ -111,6 +117,9 @@ private slots:
     void fitToImage(MdiChild *child);
     void createMdiChildView();
     void updateMdiChildView();
+    void refreshMdiChildView();
+    void startMdiChildViewRefresh(MdiChild *viewChild);
+    void finishMdiChildViewRefresh(MdiChild *viewChild);
     void closeMdiChildView();
     QString getMdiChildViewLabel(QObject *s);
     QImage getMdiChildViewImage(QImage image, QString str);
@@ -118,14 +127,18 @@ private slots:
     void convertGrayImage();
     void equalizeHistogram();
     void adaptiveContrastEnhancement();
+    void contrastLimitedEqualize();
     void spaceDomainFiltering();
     void frequencyDomainFiltering();
     void embossFiltering();
+    void gaussianFiltering();
+    void medianFiltering();
     void erodeOperation();
     void dilateOperation();
     void OpenOperation();
     void CloseOperation();
     void thresholdSegment();
+    void labelComponents();
     void switchLanguage();
 
 private:
@@ -152,6 +165,8 @@ private:
     QAction *exitAct;
     QMenu *editMenu;
     QToolBar *editToolBar;
+    QAction *undoAct;
+    QAction *redoAct;
 
     QTranslator translator;
     QMenu *helpMenu;
@@ -190,6 +205,7 @@ private:
     QAction *fitToWindowAct;
     QAction *grayViewAct;
     QAction *spectrumViewAct;
+    QAction *distanceViewAct;
     QMenu *histViewMenu;
     QAction *histViewYAct;
     QAction *histViewRAct;
@@ -210,11 +226,14 @@ private:
     QAction *convertGrayImageAct;
     QAction *equalizeHistogramAct;
     QAction *adaptiveContrastEnhancementAct;
+    QAction *claheAct;
 
     QMenu *filterMenu;
     QAction *timeDomainAct;
     QAction *frequencyDomainAct;
     QAction *embossFilterAct;
+    QAction *gaussianBlurAct;
+    QAction *medianFilterAct;
 
     QMenu *morphologyMenu;
     QAction *erodeAct;
@@ -224,7 +243,10 @@ private:
 
     QMenu *segmentMenu;
     QAction *thresholdAct;
+    QAction *labelAct;
 
+    qint64 historyBudget;
+    bool historyCompression;
 };
 
 #endif
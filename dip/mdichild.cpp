@@ -58,6 +58,13 @@ MdiChild::MdiChild()
     setAttribute(Qt::WA_DeleteOnClose);
     isUntitled = true;
     isModified = false;
+    version = 0;
+    viewDirty = false;
+    viewVersion = 0;
+    viewRefreshQueued = false;
+    viewRefreshTimer.setSingleShot(true);
+    viewRefreshTimer.setInterval(50);
+    connect(&viewRefreshTimer, &QTimer::timeout, this, [this]() { viewport()->update(); });
 }
 
 MdiChild::MdiChild(QObject *owner)
@@ -66,6 +73,13 @@ MdiChild::MdiChild(QObject *owner)
     setAttribute(Qt::WA_DeleteOnClose);
     isUntitled = true;
     isModified = false;
+    version = 0;
+    viewDirty = false;
+    viewVersion = 0;
+    viewRefreshQueued = false;
+    viewRefreshTimer.setSingleShot(true);
+    viewRefreshTimer.setInterval(50);
+    connect(&viewRefreshTimer, &QTimer::timeout, this, [this]() { viewport()->update(); });
 }
 
 void MdiChild::newFile()
@@ -93,11 +107,10 @@ bool MdiChild::loadFromFile(const QString &fileName)
     }
 
     QApplication::setOverrideCursor(Qt::WaitCursor);
-    this->imageItem.setPixmap(QPixmap::fromImage(image));
-    this->scene.addItem(&imageItem);
-    this->setScene(&this->scene);
+    showImage();
     QApplication::restoreOverrideCursor();
 
+    history.clear();
     setCurrentFile(fileName);
     connect(this, &MdiChild::imageChanged,
             this, &MdiChild::imageWasModified);
@@ -109,9 +122,7 @@ bool MdiChild::loadFromImage(const QImage &newImage)
 {
     this->image = newImage;
     QApplication::setOverrideCursor(Qt::WaitCursor);
-    this->imageItem.setPixmap(QPixmap::fromImage(image));
-    this->scene.addItem(&imageItem);
-    this->setScene(&this->scene);
+    showImage();
     QApplication::restoreOverrideCursor();
 
     connect(this, &MdiChild::imageChanged,
@@ -207,6 +218,7 @@ void MdiChild::setCurrentFile(const QString &fileName)
     curFile = fileName;
     isUntitled = false;
     isModified = false;
+    history.markSaved();
     setWindowModified(false);
     setWindowTitle(userFriendlyCurrentFile() + "[*]");
 }
@@ -260,15 +272,75 @@ bool MdiChild::paste()
 
 void MdiChild::setImage(QImage newImage)
 {
+    if (!this->owner) // only the owner keeps a history, views are recomputed from it
+        history.record(image, newImage);
     image = newImage;
-    QApplication::setOverrideCursor(Qt::WaitCursor);
-    this->scene.addPixmap(QPixmap::fromImage(image));
+    updateImage();
+}
+
+bool MdiChild::undo()
+{
+    if (!history.undo(image))
+        return false;
+    updateImage();
+    return true;
+}
+
+bool MdiChild::redo()
+{
+    if (!history.redo(image))
+        return false;
+    updateImage();
+    return true;
+}
+
+// hand the current image to the tiled item, only the changed tiles are rebuilt
+void MdiChild::showImage()
+{
+    this->imageItem.setImage(image);
+    if (!this->imageItem.scene())
+        this->scene.addItem(&imageItem);
+    this->scene.setSceneRect(imageItem.boundingRect());
     this->setScene(&this->scene);
+}
+
+void MdiChild::updateImage()
+{
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    showImage();
     QApplication::restoreOverrideCursor();
-    isModified = true;
+    // undo and redo can return to the saved image, views have no history and are always modified
+    isModified = this->owner || !history.isAtSavePoint();
+    version++;
     emit imageChanged();
 }
 
+/*
+*Summary: mark a derived view as out of date after its owner changed
+*Describtion:
+*    Nothing is recomputed here. Successive calls restart the timer, so a burst of
+*    edits only triggers one refresh. When the timer expires the viewport is
+*    scheduled for repainting, and paintEvent asks for the refresh. Hidden,
+*    minimized or fully covered views never get a paint event and stay dirty
+*    until they are shown again.
+*/
+
+void MdiChild::markViewDirty()
+{
+    viewDirty = true;
+    viewRefreshTimer.start();
+}
+
+void MdiChild::paintEvent(QPaintEvent *event)
+{
+    if (viewDirty && !viewRefreshTimer.isActive())
+    {
+        viewDirty = false;
+        emit viewRefreshRequested();
+    }
+    QGraphicsView::paintEvent(event);
+}
+
 void MdiChild::zoomIn()
 {
     this->scale(1.25, 1.25);
@@ -53,6 +53,10 @@
 
 #include <QGraphicsView>
 #include <QGraphicsItem>
+#include <QTimer>
+#include <QFutureWatcher>
+#include "imagehistory.h"
+#include "tiledimageitem.h"
 
 class MdiChild : public QGraphicsView   // The QGraphicsView class provides a widget for displaying the contents of a QGraphicsScene.
 {
@@ -70,6 +74,10 @@ public:
     bool save();
     bool saveAs();
     bool saveFile(const QString &fileName);
+    bool undo();
+    bool redo();
+    bool canUndo() const { return history.canUndo(); }
+    bool canRedo() const { return history.canRedo(); }
     void zoomIn();
     void zoomOut();
     void normalSize();
@@ -78,30 +86,43 @@ public:
     QString currentFile() { return curFile; }
     void setCurrentFile(const QString &fileName);
     void setLabel(const QString &str);
+    quint64 imageVersion() const { return version; }
+    void markViewDirty();
 
     QObject *owner;
     QGraphicsScene scene;
-    QGraphicsPixmapItem imageItem;
+    TiledImageItem imageItem;
     QImage image;
     QString label;
+    ImageHistory history;
+    QFutureWatcher<QImage> viewWatcher;     // derived view: the refresh in flight
+    quint64 viewVersion;        // derived view: owner version the refresh computes
+    bool viewRefreshQueued;     // derived view: refresh requested while one was in flight
     void setImage(QImage newImage);
 
 protected:
     void closeEvent(QCloseEvent *event) override;
+    void paintEvent(QPaintEvent *event) override;
 
 private slots:
     void imageWasModified();
 signals:
     void imageChanged();
     void ownerClosed();
+    void viewRefreshRequested();
 
 private:
     bool maybeSave();
+    void showImage();
+    void updateImage();
     QString strippedName(const QString &fullFileName);
 
     QString curFile;
     bool isUntitled;
     bool isModified;
+    quint64 version;            // incremented on every image change
+    bool viewDirty;             // derived view: owner changed since the last refresh
+    QTimer viewRefreshTimer;    // derived view: coalesces successive owner changes
 };
 
 #endif
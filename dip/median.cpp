@@ -0,0 +1,184 @@
+#include "median.h"
+#include "imageprocess.h"
+#include "scratcharena.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// 256 fine bins, grouped into 16 coarse bins of 16 gray values
+struct MedianHistogram
+{
+    quint16 coarse[16];
+    quint16 fine[256];
+};
+
+static inline void addHistogram(MedianHistogram &dst, const MedianHistogram &src)
+{
+    for (int i=0; i<16; i++)
+        dst.coarse[i] += src.coarse[i];
+    for (int i=0; i<256; i++)
+        dst.fine[i] += src.fine[i];
+}
+
+// dst += add - sub, the loops are plain 16 bit lane operations the compiler vectorizes
+static inline void slideHistogram(MedianHistogram &dst, const MedianHistogram &add, const MedianHistogram &sub)
+{
+    for (int i=0; i<16; i++)
+        dst.coarse[i] += add.coarse[i] - sub.coarse[i];
+    for (int i=0; i<256; i++)
+        dst.fine[i] += add.fine[i] - sub.fine[i];
+}
+
+// gray value of the given rank, the coarse bins skip 16 fine bins at a time
+static inline uchar histogramRank(const MedianHistogram &hist, int rank)
+{
+    int sum = 0;
+    int c = 0;
+    while (sum + hist.coarse[c] <= rank)
+        sum += hist.coarse[c++];
+    int v = c*16;
+    while (sum + hist.fine[v] <= rank)
+        sum += hist.fine[v++];
+    return (uchar)v;
+}
+
+// output rows y0 .. y1-1 of a padded strip, its rows y .. y+2*radius are the window rows of output row y
+static void medianBand(const uchar *padded, int nw, int w, int cn, int radius, int y0, int y1,
+                       MedianHistogram *columns, MedianHistogram *window, uchar *dst)
+{
+    int size = 2*radius + 1;
+    int rank = size*size / 2;
+
+    // column histograms of the padded rows y0 .. y0+2*radius-1, completed in the row loop
+    memset(columns, 0, nw*cn*sizeof(MedianHistogram));
+    for (int y=y0; y<y0+2*radius; y++)
+    {
+        const uchar *p = padded + y*nw*cn;
+        for (int i=0; i<nw*cn; i++)
+        {
+            columns[i].coarse[p[i] >> 4]++;
+            columns[i].fine[p[i]]++;
+        }
+    }
+
+    for (int y=y0; y<y1; y++)
+    {
+        // move the column histograms down: add padded row y+2*radius, remove row y-1
+        const uchar *enter = padded + (y+2*radius)*nw*cn;
+        for (int i=0; i<nw*cn; i++)
+        {
+            columns[i].coarse[enter[i] >> 4]++;
+            columns[i].fine[enter[i]]++;
+        }
+        if (y > y0)
+        {
+            const uchar *leave = padded + (y-1)*nw*cn;
+            for (int i=0; i<nw*cn; i++)
+            {
+                columns[i].coarse[leave[i] >> 4]--;
+                columns[i].fine[leave[i]]--;
+            }
+        }
+
+        memset(window, 0, cn*sizeof(MedianHistogram));
+        for (int x=0; x<size; x++)
+            for (int c=0; c<cn; c++)
+                addHistogram(window[c], columns[x*cn+c]);
+
+        uchar *d = dst + y*w*cn;
+        for (int x=0; x<w; x++)
+        {
+            if (x > 0)
+            {
+                for (int c=0; c<cn; c++)
+                    slideHistogram(window[c], columns[(x+2*radius)*cn+c], columns[(x-1)*cn+c]);
+            }
+            for (int c=0; c<cn; c++)
+                d[x*cn+c] = histogramRank(window[c], rank);
+        }
+    }
+}
+
+/*
+*Summary: median filter with a constant cost per pixel (Perreault - Hebert)
+*Parameters:
+*    uchar *src : w*h*cn interleaved input values, see splitImageChannel()
+*    int w : image width
+*    int h : image height
+*    int cn : channel count
+*    int radius : the window is (2*radius+1) x (2*radius+1), at most 127
+*    BorderType borderType : border extrapolation, see copyMakeBorder() (zero for BORDER_CONSTANT)
+*    uchar *dst : w*h*cn interleaved output values
+*Describtion:
+*    Every column of the padded image keeps the histogram of the 2*radius+1 rows around the current
+*    row, moving down one row costs one add and one remove per column. Along a row the window
+*    histogram is the sum of 2*radius+1 column histograms, moving right adds the entering column
+*    histogram and subtracts the leaving one. None of this depends on the radius. The median is
+*    located through 16 coarse bins first and then the 16 fine bins of the selected coarse bin.
+*    The image is padded in strips of as many rows as the scratch memory budget allows (see
+*    ScratchArena::fitUnits()), the rows of a strip are split into one band per thread and each
+*    band builds its own column histograms.
+*/
+
+void medianFilter(uchar *src, int w, int h, int cn, int radius, BorderType borderType, uchar *dst)
+{
+    radius = qBound(0, radius, 127);    // (2*radius+1)^2 must fit into the 16 bit bins
+    int nw = w + 2*radius;
+    uchar constBorder[3] = {0};
+
+    int threads = 1;
+#ifdef _OPENMP
+    threads = qBound(1, omp_get_max_threads(), qMax(h, 1));
+#endif
+
+    // the column histograms of every band are needed whatever the strip height
+    ScratchScope scratch;
+    MedianHistogram *columns = scratch.alloc<MedianHistogram>(threads*nw*cn);
+    MedianHistogram *windows = scratch.alloc<MedianHistogram>(threads*cn);
+    qint64 row_bytes = nw*cn;
+    int strip_rows = ScratchArena::fitUnits(row_bytes, h, 2*radius*row_bytes);
+    uchar *padded = scratch.alloc<uchar>((strip_rows + 2*radius)*row_bytes);
+
+    for (int s0=0; s0<h; s0+=strip_rows)
+    {
+        int rows = qMin(strip_rows, h-s0);
+        copyMakeBorderRows(src, w, h, cn, radius, radius, radius, radius, borderType, constBorder,
+                           s0, rows + 2*radius, padded);
+
+        int bands = qMin(threads, rows);
+        int band_rows = (rows + bands - 1) / bands;
+#pragma omp parallel for
+        for (int band=0; band<bands; band++)
+        {
+            int y0 = band*band_rows;
+            int y1 = qMin(y0 + band_rows, rows);
+            if (y0 < y1)
+                medianBand(padded, nw, w, cn, radius, y0, y1, columns + band*nw*cn, windows + band*cn,
+                           dst + s0*w*cn);
+        }
+    }
+}
+
+/*
+*Summary: median filter of an image
+*Return:
+*    Format_Grayscale8 image for gray input, Format_RGB888 image otherwise
+*/
+
+QImage medianFilter(const QImage &image, int radius, BorderType borderType)
+{
+    int w = image.width();
+    int h = image.height();
+    int cn = imageChannelCount(image);
+
+    QImage src = image;
+    ScratchScope scratch("medianFilter");
+    uchar *pixels = scratch.alloc<uchar>(w*h*cn);
+    uchar *filtered = scratch.alloc<uchar>(w*h*cn);
+    splitImageChannel(src, pixels, cn);
+    medianFilter(pixels, w, h, cn, radius, borderType, filtered);
+
+    QImage dst;
+    concatenateImageChannel(filtered, w, h, cn, dst);
+    return dst;
+}
@@ -0,0 +1,10 @@
+#ifndef MEDIAN_H
+#define MEDIAN_H
+
+#include <QImage>
+#include "padding.h"
+
+void medianFilter(uchar *src, int w, int h, int cn, int radius, BorderType borderType, uchar *dst);
+QImage medianFilter(const QImage &image, int radius, BorderType borderType);
+
+#endif // MEDIAN_H
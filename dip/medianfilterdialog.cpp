@@ -0,0 +1,102 @@
+#include "medianfilterdialog.h"
+
+MedianFilterDialog::MedianFilterDialog(QImage inputImage)
+{
+    srcImage = inputImage;
+
+    dstImage = medianFilter(srcImage, radius, borderType);
+
+    iniUI();
+
+    srcImageLabel->setPixmap(QPixmap::fromImage(srcImage));
+    dstImageLabel->setPixmap(QPixmap::fromImage(dstImage));
+}
+
+void MedianFilterDialog::iniUI()
+{
+    // two image labels
+    srcImageLabel = new QLabel();
+    srcImageLabel->setAlignment(Qt::AlignCenter);
+    dstImageLabel = new QLabel();
+    dstImageLabel->setAlignment(Qt::AlignCenter);
+
+    // window radius, the cost per pixel does not depend on it
+    radiusLabel = new QLabel(tr("Radius"));
+    radiusSlider = new FloatSlider(Qt::Horizontal);
+    radiusEdit = new QLineEdit();
+    radiusLabel->setMinimumWidth(30);
+    radiusLabel->setAlignment(Qt::AlignRight);
+    radiusEdit->setMinimumWidth(16);
+    radiusSlider->setFloatRange(1, 50);
+    radiusSlider->setFloatStep(1);
+    radiusSlider->setFloatValue(radius);
+    radiusEdit->setText(QString("%1").arg(radius));
+
+    // border type, in the order of BorderType
+    borderTypeLabel = new QLabel(tr("Border"));
+    borderTypeLabel->setAlignment(Qt::AlignRight);
+    borderTypeComboBox = new QComboBox;
+    borderTypeComboBox->addItem(tr("replicate"));
+    borderTypeComboBox->addItem(tr("reflect"));
+    borderTypeComboBox->addItem(tr("reflect101"));
+    borderTypeComboBox->addItem(tr("wrap"));
+    borderTypeComboBox->addItem(tr("zero padding"));
+    borderTypeComboBox->setCurrentIndex(borderType);
+
+    // signal slot
+    connect(radiusSlider, SIGNAL(floatValueChanged(float)), this, SLOT(updateDstImage(float)));
+    connect(borderTypeComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(updateDstImage(int)));
+
+    // three buttons
+    btnOK = new QPushButton(tr("OK"));
+    btnCancel = new QPushButton(tr("Cancel"));
+    btnClose = new QPushButton(tr("Exit"));
+
+    connect(btnOK, SIGNAL(clicked()), this, SLOT(accept()));
+    connect(btnCancel, SIGNAL(clicked()), this, SLOT(reject()));
+    connect(btnClose, SIGNAL(clicked()), this, SLOT(close()));
+
+    QHBoxLayout *layout1 = new QHBoxLayout;
+    layout1->addWidget(srcImageLabel);
+    layout1->addWidget(dstImageLabel);
+
+    QHBoxLayout *layout2 = new QHBoxLayout;
+    layout2->addWidget(radiusLabel, 3);
+    layout2->addWidget(radiusSlider, 5);
+    layout2->addWidget(radiusEdit, 2);
+    layout2->addStretch();
+
+    layout2->addWidget(borderTypeLabel, 3);
+    layout2->addWidget(borderTypeComboBox, 5);
+
+    QHBoxLayout *layout3=new QHBoxLayout;
+    layout3->addStretch();
+    layout3->addWidget(btnOK);
+    layout3->addWidget(btnCancel);
+    layout3->addStretch();
+    layout3->addWidget(btnClose);
+
+    // main layout
+    QVBoxLayout *mainlayout = new QVBoxLayout;
+    mainlayout->addLayout(layout1, 8);
+    mainlayout->addLayout(layout2, 1);
+    mainlayout->addLayout(layout3, 1);
+    setLayout(mainlayout);
+}
+
+void MedianFilterDialog::updateDstImage(float value)
+{
+    radius = (int)value;
+    radiusEdit->setText(QString("%1").arg(radius));
+
+    dstImage = medianFilter(srcImage, radius, borderType);
+    dstImageLabel->setPixmap(QPixmap::fromImage(dstImage));
+}
+
+void MedianFilterDialog::updateDstImage(int index)
+{
+    borderType = (BorderType)index;
+
+    dstImage = medianFilter(srcImage, radius, borderType);
+    dstImageLabel->setPixmap(QPixmap::fromImage(dstImage));
+}
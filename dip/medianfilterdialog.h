@@ -0,0 +1,60 @@
+#ifndef MEDIANFILTERDIALOG_H
+#define MEDIANFILTERDIALOG_H
+
+#include <QDialog>
+#include <QLabel>
+#include <QSlider>
+#include <QComboBox>
+#include <QBoxLayout>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QImage>
+#include "median.h"
+#include "floatslider.h"
+
+QT_BEGIN_NAMESPACE
+class QLabel;
+class QSlider;
+class QComboBox;
+class QLineEdit;
+class QPushButton;
+class QBoxLayout;
+class QHBoxLayout;
+class QVBoxLayout;
+QT_END_NAMESPACE
+
+class MedianFilterDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    MedianFilterDialog(QImage inputImage);
+    QImage getImage() {return dstImage;}
+private:
+    void iniUI();
+    QImage srcImage;
+    QImage dstImage;
+    QLabel *srcImageLabel;
+    QLabel *dstImageLabel;
+
+    FloatSlider *radiusSlider;
+    QLineEdit *radiusEdit;
+    QLabel *radiusLabel;
+
+    QLabel *borderTypeLabel;
+    QComboBox *borderTypeComboBox;
+
+    QPushButton     *btnOK;
+    QPushButton     *btnCancel;
+    QPushButton     *btnClose;
+
+    int radius = 1;
+    BorderType borderType = BORDER_REFLECT_101;
+
+private slots:
+    void updateDstImage(float value);
+    void updateDstImage(int index);
+};
+
+#endif // MEDIANFILTERDIALOG_H
@@ -80,6 +80,14 @@ void OpenDialog::Openning(QImage &src_image, QImage &dst_image)
         { 1,1,1,1,1,1,1 },
         { 1,1,1,1,1,1,1 } };
     int sizeKernel = 7;
+    // gray image: single channel erosion and dilation, Format_Grayscale8 result
+    if (imageChannelCount(src_image) == 1)
+    {
+        QImage gray_temp;
+        grayMorphology(src_image, &kernel[0][0], sizeKernel, false, gray_temp);
+        grayMorphology(gray_temp, &kernel[0][0], sizeKernel, true, dst_image);
+        return;
+    }
     QColor color;
     /*erosion operation*/
     for (int y = sizeKernel / 2; y < src_image.height() - sizeKernel / 2; y++)
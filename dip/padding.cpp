@@ -1,4 +1,6 @@
 #include "padding.h"
+#include "scratcharena.h"
+#include <string.h>
 
 
 int borderInterpolate( int p, int len, int borderType )
@@ -34,126 +36,208 @@ int borderInterpolate( int p, int len, int borderType )
     return p;
 }
 
-void copyMakeBorder( const uchar* src, int w, int h,
-                        uchar* dst, int nw, int nh,
-                        int top, int left, int cn, int borderType )
-{
-    int i, j, k, elemSize = 1;
-
-    int* tab = new int [(nw - w)*cn];
-    int right = nw - w - left;
-    int bottom = nh - h - top;
-
-    for( i = 0; i < left; i++ )
-    {
-        j = borderInterpolate(i - left, w, borderType)*cn;
-        for( k = 0; k < cn; k++ )
-            tab[i*cn + k] = j + k;
-    }
-
-    for( i = 0; i < right; i++ )
-    {
-        j = borderInterpolate(w + i, w, borderType)*cn;
-        for( k = 0; k < cn; k++ )
-            tab[(i+left)*cn + k] = j + k;
-    }
-
-    w *= cn;
-    nw *= cn;
-    left *= cn;
-    right *= cn;
-
-    uchar* dstInner = dst + nw*top + left*elemSize;
-
-    for( i = 0; i < h; i++, dstInner += nw, src += w )
-    {
-        if( dstInner != src )
-            memcpy(dstInner, src, w*elemSize);
-        for( j = 0; j < left; j++ )
-            dstInner[j - left] = src[tab[j]];
-        for( j = 0; j < right; j++ )
-            dstInner[j + w] = src[tab[j + left]];
-    }
+/*
+*Summary: border index table of one image axis
+*Parameters:
+*    int len : image width or height
+*    int radius : number of extrapolated entries on each side
+*    BorderType borderType : border extrapolation
+*    int *tab : output len+2*radius entries, tab[p+radius] is the index used for p, -1 for BORDER_CONSTANT
+*/
 
-    nw *= elemSize;
-    dst += nw*top;
+void borderTable(int len, int radius, BorderType borderType, int *tab)
+{
+    for (int p=-radius; p<len+radius; p++)
+        tab[p+radius] = borderInterpolate(p, len, borderType);
+}
 
-    for( i = 0; i < top; i++ )
+/*
+*Summary: row pointers of a virtually padded image
+*Parameters:
+*    const uchar *src : w*h*cn interleaved values, not padded
+*    int radius : number of extrapolated rows on top and bottom
+*    BorderType borderType : border extrapolation
+*    const uchar *constRow : w*cn values used for the rows outside of the image with BORDER_CONSTANT
+*    const uchar **rows : output h+2*radius pointers, rows[y+radius] is row y
+*Describtion:
+*    Kernels read rows through the table, so the vertical border costs no copy at all.
+*/
+
+void borderRows(const uchar *src, int w, int h, int cn, int radius, BorderType borderType,
+                const uchar *constRow, const uchar **rows)
+{
+    for (int p=-radius; p<h+radius; p++)
     {
-        j = borderInterpolate(i - top, h, borderType);
-        memcpy(dst + (i - top)*nw, dst + j*nw, nw);
+        int y = borderInterpolate(p, h, borderType);
+        rows[p+radius] = y < 0 ? constRow : src + y*w*cn;
     }
+}
 
-    for( i = 0; i < bottom; i++ )
+/*
+*Summary: neighbourhood of one border pixel
+*Parameters:
+*    const uchar *const *rows : 2*hkh+1 row pointers, rows y-hkh .. y+hkh (see borderRows())
+*    const int *tab : column table with radius hkw (see borderTable())
+*    int x : column of the pixel
+*    uchar *patch : output (2*hkh+1) rows of (2*hkw+1)*cn values, BORDER_CONSTANT columns are 0
+*Describtion:
+*    Only the pixels close to the left and right border are resolved through the table, a kernel
+*    runs on the patch with the pixel in its center exactly like on an interior pixel.
+*/
+
+void gatherBorderPatch(const uchar *const *rows, int hkh, const int *tab, int hkw, int x, int cn, uchar *patch)
+{
+    int kw = 2*hkw+1;
+    for (int n=0; n<2*hkh+1; n++)
     {
-        j = borderInterpolate(i + h, h, borderType);
-        memcpy(dst + (i + h)*nw, dst + j*nw, nw);
+        for (int m=0; m<kw; m++)
+        {
+            int i = tab[x+m];
+            uchar *p = patch + (n*kw+m)*cn;
+            for (int c=0; c<cn; c++)
+                p[c] = i < 0 ? 0 : rows[n][i*cn+c];
+        }
     }
-    delete [] tab;
 }
 
-
-void copyMakeConstBorder( const uchar* src, int w, int h,
-                             uchar* dst, int nw, int nh,
-                             int top, int left, int cn, const uchar *value )
+// one padded row, CN is the channel count or 0 for a run-time channel count
+template <typename T, int CN>
+static inline void makeBorderRow(const T *srow, int w, int cn, int left, int right,
+                                 const int *tab, const T *value, T *drow)
 {
-    int i, j;
-    uchar* constBuf = new uchar[nw*cn]; //calloc, malloc -> free
-    int right = nw - w - left;
-    int bottom = nh - h - top;
-
-    memset(dst, 0, nw*nh*cn);
-
-    for( i = 0; i < nw; i++ )
+    const int ncn = CN ? CN : cn;
+    memcpy(drow + left*ncn, srow, w*ncn*sizeof(T));
+    for (int i=0; i<left+right; i++)
     {
-        for( j = 0; j < cn; j++ )
-            constBuf[i*cn + j] = value[j];
+        // left border first, then the right one behind the copied row
+        T *d = drow + (i < left ? i : w+i)*ncn;
+        int x = tab[i];
+        if (x < 0)
+        {
+            for (int c=0; c<ncn; c++)
+                d[c] = value[c];
+        }
+        else
+        {
+            const T *s = srow + x*ncn;
+            for (int c=0; c<ncn; c++)
+                d[c] = s[c];
+        }
     }
+}
 
-    w *= cn;
-    nw *= cn;
-    left *= cn;
-    right *= cn;
+template <typename T, int CN>
+static void makeBorder(const T *src, int w, int h, int cn, int top,
+                       int left, int right, BorderType borderType, const T *value,
+                       int y0, int rows, T *dst)
+{
+    const int ncn = CN ? CN : cn;
+    int nw = w+left+right;
 
-    uchar* dstInner = dst + nw*top + left;
-    for( i = 0; i < h; i++, dstInner += nw, src += w )
+    // source pixel of every border column, -1 for the constant
+    ScratchScope scratch;
+    int *tab = scratch.alloc<int>(left+right+1);
+    for (int i=0; i<left; i++)
+        tab[i] = borderInterpolate(i-left, w, borderType);
+    for (int i=0; i<right; i++)
+        tab[left+i] = borderInterpolate(w+i, w, borderType);
+
+    // a full row of the constant for the top and bottom border
+    T *constRow = scratch.alloc<T>(nw*ncn);
+    for (int i=0; i<nw; i++)
+        for (int c=0; c<ncn; c++)
+            constRow[i*ncn+c] = value[c];
+
+#pragma omp parallel for
+    for (int y=0; y<rows; y++)
     {
-        memcpy( dstInner, src, w );
-        memcpy( dstInner - left, constBuf, left );
-        memcpy( dstInner + w, constBuf, right );
+        T *drow = dst + y*nw*ncn;
+        int sy = borderInterpolate(y0+y-top, h, borderType);
+        if (sy < 0)
+            memcpy(drow, constRow, nw*ncn*sizeof(T));
+        else
+            makeBorderRow<T, CN>(src + sy*w*ncn, w, ncn, left, right, tab, value, drow);
     }
+}
 
-    //p += nw*top;
-    dst += nw*top;
-    for( i = 0; i < top; i++ )
-        memcpy(dst + (i - top)*nw, constBuf, nw);
-
-    for( i = 0; i < bottom; i++ )
-        memcpy(dst + (i + h)*nw, constBuf, nw);
-
-    delete [] constBuf;
+/*
+*Summary: copy an image into the middle of a larger one and extrapolate the border
+*Parameters:
+*    const T *src : w*h*cn interleaved values
+*    int cn : channel count
+*    int top, bottom, left, right : border sizes in pixels
+*    BorderType borderType : border extrapolation
+*    const T *value : cn values for BORDER_CONSTANT, nullptr for zeros
+*    T *dst : output (w+left+right)*(h+top+bottom)*cn values
+*Describtion:
+*    Every output row is either a copy of a source row with its left and right border taken from a
+*    column table, or the constant row. The usual channel counts 1, 2, 3 and 4 are compiled with a
+*    constant channel count, so the per pixel copies of the border become fixed size moves and
+*    shuffles the compiler vectorizes. Rows are filled in parallel.
+*    Instantiated for uchar, quint16 and float.
+*/
+
+template <typename T>
+void copyMakeBorder(const T *src, int w, int h, int cn, int top, int bottom,
+                    int left, int right, BorderType borderType, const T *value, T *dst)
+{
+    copyMakeBorderRows(src, w, h, cn, top, bottom, left, right, borderType, value, 0, h+top+bottom, dst);
 }
 
-void copyMakeBorder(uchar *src, int w, int h, int cn, int top, int bottom,
-                    int left, int right, BorderType borderType, const uchar *value, uchar *dst)
+/*
+*Summary: rows y0 .. y0+rows-1 of the image copyMakeBorder() would make
+*Parameters:
+*    int y0 : first row of the padded image, 0 is the first row of the top border
+*    int rows : number of rows
+*    T *dst : output rows*(w+left+right)*cn values
+*Describtion:
+*    Lets filters pad one strip of rows at a time instead of the whole image.
+*/
+
+template <typename T>
+void copyMakeBorderRows(const T *src, int w, int h, int cn, int top, int bottom,
+                        int left, int right, BorderType borderType, const T *value,
+                        int y0, int rows, T *dst)
 {
-    int nw = w+left+right;
-    int nh = h+top+bottom;
+    Q_UNUSED(bottom);
+    QVarLengthArray<T, 4> constValue(cn);
+    memset(constValue.data(), 0, cn*sizeof(T));
+    if (value && borderType == BORDER_CONSTANT)
+        memcpy(constValue.data(), value, cn*sizeof(T));
 
-    if(top == 0 && left == 0 && bottom == 0 && right == 0)
+    switch (cn)
     {
-        memcpy(dst, src, nw*nh*cn);
-        return;
+    case 1:
+        makeBorder<T, 1>(src, w, h, cn, top, left, right, borderType, constValue.constData(), y0, rows, dst);
+        break;
+    case 2:
+        makeBorder<T, 2>(src, w, h, cn, top, left, right, borderType, constValue.constData(), y0, rows, dst);
+        break;
+    case 3:
+        makeBorder<T, 3>(src, w, h, cn, top, left, right, borderType, constValue.constData(), y0, rows, dst);
+        break;
+    case 4:
+        makeBorder<T, 4>(src, w, h, cn, top, left, right, borderType, constValue.constData(), y0, rows, dst);
+        break;
+    default:
+        makeBorder<T, 0>(src, w, h, cn, top, left, right, borderType, constValue.constData(), y0, rows, dst);
+        break;
     }
-
-    if( borderType != BORDER_CONSTANT )
-        copyMakeBorder( src, w, h, dst, nw, nh,
-                       top, left, cn, borderType );
-    else
-        copyMakeConstBorder( src, w, h, dst, nw, nh,
-                            top, left, cn, value );
 }
 
+template void copyMakeBorder<uchar>(const uchar *src, int w, int h, int cn, int top, int bottom,
+                                    int left, int right, BorderType borderType, const uchar *value, uchar *dst);
+template void copyMakeBorder<quint16>(const quint16 *src, int w, int h, int cn, int top, int bottom,
+                                      int left, int right, BorderType borderType, const quint16 *value, quint16 *dst);
+template void copyMakeBorder<float>(const float *src, int w, int h, int cn, int top, int bottom,
+                                    int left, int right, BorderType borderType, const float *value, float *dst);
+template void copyMakeBorderRows<uchar>(const uchar *src, int w, int h, int cn, int top, int bottom,
+                                        int left, int right, BorderType borderType, const uchar *value,
+                                        int y0, int rows, uchar *dst);
+template void copyMakeBorderRows<float>(const float *src, int w, int h, int cn, int top, int bottom,
+                                        int left, int right, BorderType borderType, const float *value,
+                                        int y0, int rows, float *dst);
+
 void copyRemoveBorder(const uchar *src, int w, int h, int cn, int top, int bottom,
                     int left, int right,  uchar *dst)
 {
@@ -9,8 +9,19 @@ enum BorderType {
   BORDER_CONSTANT,      // iiiiii|abcdefgh|iiiiiii  with some specified 'i'
 };
 
-void copyMakeBorder(uchar *src, int w, int h, int cn, int top, int bottom,
-                         int left, int right, BorderType borderType, const uchar *value, uchar *dst);
+int borderInterpolate(int p, int len, int borderType);
+void borderTable(int len, int radius, BorderType borderType, int *tab);
+void borderRows(const uchar *src, int w, int h, int cn, int radius, BorderType borderType,
+                const uchar *constRow, const uchar **rows);
+void gatherBorderPatch(const uchar *const *rows, int hkh, const int *tab, int hkw, int x, int cn, uchar *patch);
+// T is uchar, quint16 or float
+template <typename T>
+void copyMakeBorder(const T *src, int w, int h, int cn, int top, int bottom,
+                    int left, int right, BorderType borderType, const T *value, T *dst);
+template <typename T>
+void copyMakeBorderRows(const T *src, int w, int h, int cn, int top, int bottom,
+                        int left, int right, BorderType borderType, const T *value,
+                        int y0, int rows, T *dst);
 void copyRemoveBorder(const uchar *src, int w, int h, int cn, int top, int bottom,
                     int left, int right,  uchar *dst);
 #endif // PADDING_H
@@ -0,0 +1,301 @@
+#include "scratcharena.h"
+#include <QMutex>
+#include <QThread>
+#include <QCoreApplication>
+#include <atomic>
+#include <algorithm>
+#include <new>
+#include <stdlib.h>
+#ifdef Q_OS_LINUX
+#include <sys/mman.h>
+#endif
+
+static const size_t HugePageSize = 2*1024*1024;
+
+static std::atomic<qint64> requestCount(0);
+static std::atomic<qint64> systemAllocationCount(0);
+static std::atomic<qint64> bytesInUse(0);
+static std::atomic<qint64> peakBytesInUse(0);
+static std::atomic<qint64> bytesCached(0);
+static std::atomic<qint64> budgetBytes(0);
+static std::atomic<qint64> residentBytes(0);
+static std::atomic<bool> logPeaks(false);
+
+static QMutex peaksMutex;
+static QHash<QByteArray, qint64> peaks;
+
+// like new[], running out of memory is not survivable for the callers
+static void *systemAllocate(size_t size)
+{
+#ifdef Q_OS_LINUX
+    if (size >= HugePageSize)
+    {
+        void *block = nullptr;
+        if (posix_memalign(&block, HugePageSize, size) != 0)
+            throw std::bad_alloc();
+        madvise(block, size, MADV_HUGEPAGE);    // only a hint, fails quietly without THP
+        return block;
+    }
+#endif
+    void *block = qMallocAligned(size, ScratchArena::Alignment);
+    if (!block)
+        throw std::bad_alloc();
+    return block;
+}
+
+static void systemFree(void *block, size_t size)
+{
+#ifdef Q_OS_LINUX
+    if (size >= HugePageSize)
+    {
+        free(block);
+        return;
+    }
+#else
+    Q_UNUSED(size);
+#endif
+    qFreeAligned(block);
+}
+
+ScratchArena::ScratchArena()
+    : cachedBytes(0), inUse(0), peak(0), depth(0)
+{
+    for (int i=0; i<ClassCount; i++)
+        freeLists[i] = nullptr;
+}
+
+ScratchArena::~ScratchArena()
+{
+    trim();
+}
+
+ScratchArena &ScratchArena::local()
+{
+    static thread_local ScratchArena arena;
+    return arena;
+}
+
+ScratchArena::Stats ScratchArena::stats()
+{
+    Stats s;
+    s.requests = requestCount.load();
+    s.systemAllocations = systemAllocationCount.load();
+    s.bytesInUse = bytesInUse.load();
+    s.peakBytesInUse = peakBytesInUse.load();
+    s.bytesCached = bytesCached.load();
+    s.residentBytes = residentBytes.load();
+    return s;
+}
+
+// 0 means unlimited
+void ScratchArena::setBudget(qint64 bytes)
+{
+    budgetBytes = qMax(bytes, (qint64)0);
+}
+
+qint64 ScratchArena::budget()
+{
+    return budgetBytes.load();
+}
+
+// memory kept between operations outside the arena (the artifact cache), counts against the budget
+void ScratchArena::setResidentBytes(qint64 bytes)
+{
+    residentBytes = qMax(bytes, (qint64)0);
+}
+
+/*
+*Summary: how many units of work fit into the memory budget
+*Parameters:
+*    qint64 bytesPerUnit : scratch bytes one unit (row, plane, tile) needs
+*    int units : number of units of the whole operation
+*    qint64 fixedBytes : scratch bytes needed however many units are processed at once
+*Return:
+*    number of units to process per pass, at least 1 and at most units
+*Describtion:
+*    Memory borrowed by all threads and the resident bytes count against the budget. With a
+*    budget of 0 or when even one unit does not fit, the answer is all units or 1 unit
+*    respectively.
+*/
+
+int ScratchArena::fitUnits(qint64 bytesPerUnit, int units, qint64 fixedBytes)
+{
+    qint64 limit = budgetBytes.load();
+    if (limit <= 0 || bytesPerUnit <= 0)
+        return qMax(units, 1);
+    qint64 available = limit - bytesInUse.load() - residentBytes.load() - fixedBytes;
+    return (int)qBound((qint64)1, available / bytesPerUnit, (qint64)qMax(units, 1));
+}
+
+// highest scratch usage of every named operation so far
+QHash<QByteArray, qint64> ScratchArena::operationPeaks()
+{
+    QMutexLocker locker(&peaksMutex);
+    return peaks;
+}
+
+// log every new operation peak, see ~ScratchScope()
+void ScratchArena::setPeakLogging(bool enabled)
+{
+    logPeaks = enabled;
+}
+
+bool ScratchArena::peakLogging()
+{
+    return logPeaks.load();
+}
+
+// operationPeaks() to the debug log, largest first
+void ScratchArena::logOperationPeaks()
+{
+    QHash<QByteArray, qint64> all = operationPeaks();
+    QList<QByteArray> names = all.keys();
+    std::sort(names.begin(), names.end(), [&all](const QByteArray &a, const QByteArray &b) {
+        return all.value(a) > all.value(b);
+    });
+    Stats s = stats();
+    qDebug("scratch memory: %lld KB peak of all operations, %lld KB cached, %lld KB resident, budget %lld KB",
+           s.peakBytesInUse / 1024, s.bytesCached / 1024, s.residentBytes / 1024, budget() / 1024);
+    for (const QByteArray &name : names)
+        qDebug("scratch memory: %s peak %lld KB", name.constData(), all.value(name) / 1024);
+}
+
+// smallest class whose blocks of 2^class bytes hold the request
+int ScratchArena::sizeClass(size_t bytes)
+{
+    int c = MinClass;
+    while (c < ClassCount-1 && ((size_t)1 << c) < bytes)
+        c++;
+    return c;
+}
+
+/*
+*Summary: a block of at least bytes bytes, from the cache if there is one
+*Describtion:
+*    The budget counts the requested bytes, not the size class, otherwise a request just
+*    above a power of two would count almost twice and fitUnits() would give up work long
+*    before the memory is actually used.
+*/
+
+void *ScratchArena::take(size_t bytes)
+{
+    int sizeClass = ScratchArena::sizeClass(bytes);
+    qint64 size = (qint64)1 << sizeClass;
+    FreeBlock *block = freeLists[sizeClass];
+    if (block)
+    {
+        freeLists[sizeClass] = block->next;
+        cachedBytes -= size;
+        bytesCached -= size;
+    }
+    else
+    {
+        block = (FreeBlock *)systemAllocate((size_t)size);
+        systemAllocationCount++;
+    }
+
+    requestCount++;
+    qint64 total = (bytesInUse += bytes);
+    qint64 totalPeak = peakBytesInUse.load();
+    while (total > totalPeak && !peakBytesInUse.compare_exchange_weak(totalPeak, total))
+        ;
+    inUse += bytes;
+    peak = qMax(peak, inUse);
+    return block;
+}
+
+// MaxCachedBytes for all threads, the budget if that is smaller
+static qint64 cacheLimit()
+{
+    qint64 limit = budgetBytes.load();
+    return limit > 0 ? qMin(limit, ScratchArena::MaxCachedBytes) : ScratchArena::MaxCachedBytes;
+}
+
+void ScratchArena::give(void *data, size_t bytes)
+{
+    if (!data)
+        return;
+    int sizeClass = ScratchArena::sizeClass(bytes);
+    qint64 size = (qint64)1 << sizeClass;
+    bytesInUse -= bytes;
+    inUse -= bytes;
+    if ((bytesCached += size) > cacheLimit())
+    {
+        bytesCached -= size;
+        systemFree(data, (size_t)size);
+        return;
+    }
+    FreeBlock *block = (FreeBlock *)data;
+    block->next = freeLists[sizeClass];
+    freeLists[sizeClass] = block;
+    cachedBytes += size;
+}
+
+// free every cached block of this thread
+void ScratchArena::trim()
+{
+    for (int c=0; c<ClassCount; c++)
+    {
+        while (freeLists[c])
+        {
+            FreeBlock *block = freeLists[c];
+            freeLists[c] = block->next;
+            systemFree(block, (size_t)1 << c);
+        }
+    }
+    bytesCached -= cachedBytes;
+    cachedBytes = 0;
+}
+
+// blocks cached by idle pool and OpenMP threads would never be reused by the next operation
+static bool keepsCache()
+{
+    QCoreApplication *app = QCoreApplication::instance();
+    return !app || QThread::currentThread() == app->thread();
+}
+
+ScratchScope::ScratchScope(const char *operation)
+    : arena(ScratchArena::local()), operation(operation)
+{
+    arena.depth++;
+    baseBytes = arena.inUse;
+    outerPeak = arena.peak;
+    arena.peak = arena.inUse;
+}
+
+ScratchScope::~ScratchScope()
+{
+    if (operation)
+    {
+        qint64 bytes = peakBytes();
+        QMutexLocker locker(&peaksMutex);
+        qint64 &recorded = peaks[QByteArray(operation)];
+        if (bytes > recorded && logPeaks.load())
+            qDebug("scratch memory: %s peak %lld KB", operation, bytes / 1024);
+        recorded = qMax(recorded, bytes);
+    }
+    for (int i=blocks.size()-1; i>=0; i--)
+        arena.give(blocks[i].data, blocks[i].bytes);
+    arena.peak = qMax(outerPeak, arena.peak);
+    if (--arena.depth == 0 && !keepsCache())
+        arena.trim();
+}
+
+// highest number of bytes borrowed by this scope and the scopes nested in it
+qint64 ScratchScope::peakBytes() const
+{
+    return arena.peak - baseBytes;
+}
+
+/*
+*Summary: borrow an uninitialized, 64 byte aligned buffer until the scope ends
+*/
+
+void *ScratchScope::allocate(size_t bytes)
+{
+    Block block;
+    block.bytes = bytes;
+    block.data = arena.take(bytes);
+    blocks.append(block);
+    return block.data;
+}
@@ -0,0 +1,119 @@
+#ifndef SCRATCHARENA_H
+#define SCRATCHARENA_H
+
+#include <QtGlobal>
+#include <QVarLengthArray>
+#include <QHash>
+#include <QByteArray>
+#include <stddef.h>
+
+/*
+ * Thread-local pool of 64 byte aligned scratch buffers in power-of-two size classes.
+ * Operations borrow their working buffers through a ScratchScope and give all of them
+ * back when the scope ends, so running an operation again (every slider tick) reuses
+ * memory that is already mapped instead of allocating, page faulting and zeroing it
+ * again. Blocks of 2 MB and more are backed by transparent huge pages on Linux.
+ * All threads together keep at most MaxCachedBytes of returned blocks, or the budget if it
+ * is smaller, the rest is freed. Only the GUI thread keeps its blocks between operations,
+ * worker threads (thread pool, OpenMP) free theirs when their outermost scope ends.
+ * The budget is a global limit for the scratch memory of all operations: operations ask
+ * fitUnits() how many rows, planes or tiles they may process per pass and stream the
+ * rest (FFT planes, FFT convolution tiles, median and CLAHE row strips, gaussian column
+ * strips), so only their minimal working set can exceed it. Operations that need the
+ * whole image at once (labeling, the bilateral grid) still borrow from the arena, so
+ * their memory counts against the budget of everything running beside them.
+ * The artifact cache reports the size of its entries with setResidentBytes(), they count
+ * against the budget too. Result images and the converted tiles of the image views are
+ * not part of it.
+ */
+class ScratchArena
+{
+public:
+    enum
+    {
+        Alignment = 64,
+        MinClass = 6,           // 64 bytes
+        ClassCount = 48
+    };
+    static const qint64 MaxCachedBytes = 256ll*1024*1024;
+
+    // counters of all threads, for instrumentation
+    struct Stats
+    {
+        qint64 requests;            // buffers borrowed
+        qint64 systemAllocations;   // requests that were not served from a cached block
+        qint64 bytesInUse;          // requested and not yet returned, not rounded to the size class
+        qint64 peakBytesInUse;
+        qint64 bytesCached;         // size of the returned blocks kept for reuse
+        qint64 residentBytes;       // reported by setResidentBytes()
+    };
+
+    static ScratchArena &local();
+    static Stats stats();
+
+    static void setBudget(qint64 bytes);
+    static qint64 budget();
+    static void setResidentBytes(qint64 bytes);
+    static int fitUnits(qint64 bytesPerUnit, int units, qint64 fixedBytes = 0);
+    static QHash<QByteArray, qint64> operationPeaks();
+    static void setPeakLogging(bool enabled);
+    static bool peakLogging();
+    static void logOperationPeaks();
+
+    void *take(size_t bytes);
+    void give(void *block, size_t bytes);
+    void trim();
+    static int sizeClass(size_t bytes);
+
+    ~ScratchArena();
+
+private:
+    friend class ScratchScope;
+
+    ScratchArena();
+    Q_DISABLE_COPY(ScratchArena)
+
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+    FreeBlock *freeLists[ClassCount];
+    qint64 cachedBytes;
+    qint64 inUse;           // requested by this thread and not yet returned
+    qint64 peak;            // highest inUse since the innermost scope started
+    int depth;              // open scopes of this thread
+};
+
+/*
+ * Buffers borrowed from the arena of the current thread, all of them are returned when
+ * the scope is destroyed. A scope must be used by the thread that created it. Dialogs
+ * hold one for their lifetime, on the GUI thread, for the planes their previews share.
+ * The peak of a named scope, nested scopes included, is recorded per operation name and,
+ * with peak logging on, written to the debug log whenever it grows.
+ */
+class ScratchScope
+{
+public:
+    explicit ScratchScope(const char *operation = nullptr);
+    ~ScratchScope();
+
+    void *allocate(size_t bytes);
+    template <typename T> T *alloc(size_t count) { return (T *)allocate(count*sizeof(T)); }
+    qint64 peakBytes() const;
+
+private:
+    Q_DISABLE_COPY(ScratchScope)
+
+    struct Block
+    {
+        void *data;
+        size_t bytes;
+    };
+    ScratchArena &arena;
+    const char *operation;
+    qint64 baseBytes;       // in use by enclosing scopes when the scope started
+    qint64 outerPeak;
+    QVarLengthArray<Block, 8> blocks;
+};
+
+#endif // SCRATCHARENA_H
@@ -1,34 +1,11 @@
 #include "sdfilterdialog.h"
+#include "scratcharena.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 
-// 8 kinds of image spatial domain filter masks
-float robertsX[9] = {
-     0, 0, 0,
-     0,-1, 0,
-     0, 0, 1};
-float robertsY[9] = {
-     0, 0, 0,
-     0, 0,-1,
-     0, 1, 0};
-
-float sobelX[9] = {
-    -1,-2,-1,
-     0, 0, 0,
-     1, 2, 1};
-float sobelY[9] = {
-    -1,0,1,
-    -2,0,2,
-    -1,0,1};
-
-float prewittX[9] = {
-    -1,-1,-1,
-     0, 0, 0,
-     1, 1, 1};
-float prewittY[9] = {
-    -1,0,1,
-    -1,0,1,
-    -1,0,1};
-
+// laplacian masks for the convolution front-end, the gradient operators are computed by gradientFilter()
 float laplacian4[9] = {
     0, 1,0,
     1,-4,1,
@@ -38,90 +15,6 @@ float laplacian8[9] = {
     1,-8,1,
     1, 1,1};
 
-// LoG(Laplacian of Gaussian)
-float logElement(int x, int y, float sigma)
-{
-    //const float PI = 3.141592653589793f;
-    float g = 0;
-    for(float ySubPixel = y - 0.5f; ySubPixel <= y + 0.5f; ySubPixel += 0.1f) {
-        for(float xSubPixel = x - 0.5f; xSubPixel <= x + 0.5f; xSubPixel += 0.1f) {
-            //float s = ((xSubPixel*xSubPixel)+(ySubPixel*ySubPixel)) / (2*sigma*sigma);
-            //g += (1/(PI*pow(sigma, 4))) * (s-1) * exp(-s) * 2*PI*sigma*sigma;
-            float s = ((xSubPixel*xSubPixel)+(ySubPixel*ySubPixel)) / (2*sigma*sigma);
-            g += 2 * (s-1/(sigma*sigma)) * expf(-s);
-        }
-    }
-    g /= 121;
-
-    return g;
-}
-
-float *generateLOGKernel(float sigma, int &kernelSize)
-{
-    kernelSize = (int)(4*sigma+1 + 0.5f) /2 * 2 + 1;
-    float *LOGKernel = new float[kernelSize*kernelSize];
-    double sum = 0;
-    for(int j=0; j<kernelSize; ++j){
-        for(int i=0; i<kernelSize; ++i){
-            int x = (-kernelSize/2)+i;
-            int y = (-kernelSize/2)+j;
-            LOGKernel[j*kernelSize+i] = logElement(x, y, sigma);
-            sum += LOGKernel[j*kernelSize+i];
-        }
-    }
-    // subtract mean to get zero sum
-    double mean = sum / (kernelSize * kernelSize);
-    for(int i=0; i<kernelSize*kernelSize; ++i){
-        LOGKernel[i] -= mean;
-    }
-
-    return LOGKernel;
-}
-
-static void filterProc(const uchar *src, int w, int h,
-            const float *kernel, int hkw, int hkh, uchar *dst)
-{
-    int i, j, m, n;
-    float val_r, val_g, val_b, r, g, b;
-    int nw = w-2*hkw;
-    int nh = h-2*hkh;
-    int kw = 2*hkw+1;
-    int kh = 2*hkh+1;
-
-    memset(dst, 0, nw*nh*3);
-
-    for (j=hkh; j<h-hkh; j++)
-    {
-        for (i=hkw; i<w-hkw; i++)
-        {
-            val_r = val_g  = val_b = 0;
-            for (n=-hkh; n<=hkh; n++)
-            {
-                for (m=-hkw; m<=hkw; m++)
-                {
-                    r = src[(j-n)*w*3+(i-m)*3];
-                    g = src[(j-n)*w*3+(i-m)*3+1];
-                    b = src[(j-n)*w*3+(i-m)*3+2];
-                    val_r +=  r * kernel[(n+hkh)*kw+m+hkw];
-                    val_g +=  g * kernel[(n+hkh)*kw+m+hkw];
-                    val_b +=  b * kernel[(n+hkh)*kw+m+hkw];
-                }
-            }
-            val_r = val_r>255 ? 255 : val_r;
-            val_g = val_g>255 ? 255 : val_g;
-            val_b = val_b>255 ? 255 : val_b;
-
-            val_r = val_r<0 ? 0 : val_r;
-            val_g = val_g<0 ? 0 : val_g;
-            val_b = val_b<0 ? 0 : val_b;
-
-            dst[(j-hkh)*nw*3+(i-hkw)*3] = (uchar)(val_r);
-            dst[(j-hkh)*nw*3+(i-hkw)*3+1] = (uchar)(val_g);
-            dst[(j-hkh)*nw*3+(i-hkw)*3+2] = (uchar)(val_b);
-        }
-    }
-}
-
 SDFilterDialog::SDFilterDialog(QImage inputImage)
 {
     srcImage = inputImage;
@@ -130,98 +23,92 @@ SDFilterDialog::SDFilterDialog(QImage inputImage)
     int h = srcImage.height();
     int pixel_num = w*h;
 
-    rgb = new uchar[3*pixel_num];
+    cn = imageChannelCount(srcImage);   // gray images are filtered as one plane
+    rgb = dialogScratch.alloc<uchar>(cn*pixel_num);
     borderType = 0;
     halfKernelSize = 1;
     sigma = 2;
-    maxSigma = 7;
+    maxSigma = 30;
 
     iniUI();
 
     // obtain image channels
-    splitImageChannel(srcImage, rgb);
+    splitImageChannel(srcImage, rgb, cn);
 
     int count = borderTypeComboBox->count();
     borderTypeComboBox->setCurrentIndex(count-1);
 
-    // padding
-    int hkw = 1;
-    int hkh = 1;
-    int nw = w+hkw*2;
-    int nh = h+hkh*2;
-    rgbPadded = new uchar[3*nw*nh];
-    paddedImage = QImage(nw, nh, QImage::Format_RGB888);
-    uchar constBorder[3] = {0};
-    copyMakeBorder(rgb, w, h, 3,
-                   halfKernelSize, halfKernelSize, halfKernelSize, halfKernelSize, (BorderType)borderType,
-                   constBorder, rgbPadded);
-    //concatenateImageChannel(rgbPadded, nw, nh, paddedImage);
-
-    //paddedImageLabel->setPixmap(QPixmap::fromImage(paddedImage));
-
-    robertsImage = imageFilter((int)FilterType::Roberts);
-    sobelImage = imageFilter((int)FilterType::Sobel);
-    prewittImage = imageFilter((int)FilterType::Prewitt);
-    laplacian4Image = imageFilter((int)FilterType::Laplacian4);
-    laplacian8Image = imageFilter((int)FilterType::Laplacian8);
-    LOGImage = imageLOGFilter(sigma);
+    srcImageLabel->setPixmap(QPixmap::fromImage(srcImage).scaled(srcImageLabel->width(), srcImageLabel->height()));
 
-    /*
-    srcImageLabel->setPixmap(QPixmap::fromImage(srcImage));
-    robertsImageLabel->setPixmap(QPixmap::fromImage(robertsImage));
-    sobelImageLabel->setPixmap(QPixmap::fromImage(sobelImage));
-    prewittImageLabel->setPixmap(QPixmap::fromImage(prewittImage));
-    laplacian4ImageLabel->setPixmap(QPixmap::fromImage(laplacian4Image));
-    laplacian8ImageLabel->setPixmap(QPixmap::fromImage(laplacian8Image));
-    LOGImageLabel->setPixmap(QPixmap::fromImage(LOGImage));
-    */
+    // the previews only read srcImage and rgb, they are computed as independent tasks
+    // and every label is filled in as soon as its filter is done
+    previewPool.setMaxThreadCount(QThread::idealThreadCount());
+    float s = sigma, sigmaS = spatialSigma, sigmaR = rangeSigma;
+    int low = (int)cannyLow, high = (int)cannyHigh;
+    schedulePreview(&robertsImage, robertsImageLabel,
+                    startPreview([this]() { return imageFilter(FilterType::Roberts); }));
+    schedulePreview(&sobelImage, sobelImageLabel,
+                    startPreview([this]() { return imageFilter(FilterType::Sobel); }));
+    schedulePreview(&prewittImage, prewittImageLabel,
+                    startPreview([this]() { return imageFilter(FilterType::Prewitt); }));
+    schedulePreview(&laplacian4Image, laplacian4ImageLabel,
+                    startPreview([this]() { return imageFilter(FilterType::Laplacian4); }));
+    schedulePreview(&laplacian8Image, laplacian8ImageLabel,
+                    startPreview([this]() { return imageFilter(FilterType::Laplacian8); }));
+    schedulePreview(&LOGImage, LOGImageLabel,
+                    startPreview([this, s]() { return imageLOGFilter(s); }));
+    schedulePreview(&DOGImage, DOGImageLabel,
+                    startPreview([this, s]() { return imageDOGFilter(s); }));
+    schedulePreview(&bilateralImage, bilateralImageLabel,
+                    startPreview([this, sigmaS, sigmaR]() { return imageBilateralFilter(sigmaS, sigmaR); }));
+    schedulePreview(&cannyImage, cannyImageLabel,
+                    startPreview([this, low, high]() { return cannyEdgeDetect(srcImage, 1.4f, low, high); }));
+}
 
-    srcImageLabel->setPixmap(QPixmap::fromImage(srcImage).scaled(srcImageLabel->width(), srcImageLabel->height()));
-    robertsImageLabel->setPixmap(QPixmap::fromImage(robertsImage).scaled(robertsImageLabel->width(), robertsImageLabel->height()));
-    sobelImageLabel->setPixmap(QPixmap::fromImage(sobelImage).scaled(sobelImageLabel->width(), sobelImageLabel->height()));
-    prewittImageLabel->setPixmap(QPixmap::fromImage(prewittImage).scaled(prewittImageLabel->width(), prewittImageLabel->height()));
-    laplacian4ImageLabel->setPixmap(QPixmap::fromImage(laplacian4Image).scaled(laplacian4ImageLabel->width(), laplacian4ImageLabel->height()));
-    laplacian8ImageLabel->setPixmap(QPixmap::fromImage(laplacian8Image).scaled(laplacian8ImageLabel->width(), laplacian8ImageLabel->height()));
-    LOGImageLabel->setPixmap(QPixmap::fromImage(LOGImage).scaled(LOGImageLabel->width(), LOGImageLabel->height()));
+// LoG(Laplacian of Gaussian), the smoothing is a recursive gaussian whose cost does not depend on sigma
+QImage SDFilterDialog::imageLOGFilter(float sigma)
+{
+    int w = srcImage.width();
+    int h = srcImage.height();
+
+    ScratchScope scratch;
+    uchar *filtered = scratch.alloc<uchar>(cn*w*h);
+    laplacianOfGaussian(srcImage, sigma, filtered);
 
-    delete [] rgbPadded;
-    rgbPadded = nullptr;
+    QImage dst;
+    concatenateImageChannel(filtered, w, h, cn, dst);
 
+    return dst;
 }
 
-QImage SDFilterDialog::imageLOGFilter(float sigma)
+// DoG(Difference of Gaussians), sigma and 1.6*sigma
+QImage SDFilterDialog::imageDOGFilter(float sigma)
 {
     int w = srcImage.width();
     int h = srcImage.height();
 
-    float *filterKernel;
-    int kernelSize = 0;
-    filterKernel = generateLOGKernel(sigma, kernelSize);
-
-    halfKernelSize = kernelSize/2;
-    int nw = w+halfKernelSize*2;
-    int nh = h+halfKernelSize*2;
-    rgbFilteredX = new uchar[3*w*h];
-    rgbPadded = new uchar[3*nw*nh];
-    paddedImage = QImage(nw, nh, QImage::Format_RGB888);
-
-    // padding
-    uchar constBorder[3] = {0};
-    copyMakeBorder(rgb, w, h, 3,
-                   halfKernelSize, halfKernelSize, halfKernelSize, halfKernelSize, (BorderType)borderType,
-                   constBorder, rgbPadded);
-    // filtering
-    filterProc(rgbPadded, nw, nh, filterKernel,
-               halfKernelSize, halfKernelSize, rgbFilteredX);
+    ScratchScope scratch;
+    uchar *filtered = scratch.alloc<uchar>(cn*w*h);
+    differenceOfGaussians(srcImage, sigma, 1.6f, filtered);
 
     QImage dst;
-    concatenateImageChannel(rgbFilteredX, w, h, dst);
+    concatenateImageChannel(filtered, w, h, cn, dst);
 
-    delete [] rgbFilteredX;
-    rgbFilteredX = nullptr;
+    return dst;
+}
 
-    delete [] filterKernel;
-    filterKernel = nullptr;
+// edge preserving smoothing through a bilateral grid
+QImage SDFilterDialog::imageBilateralFilter(float sigmaS, float sigmaR)
+{
+    int w = srcImage.width();
+    int h = srcImage.height();
+
+    ScratchScope scratch;
+    uchar *filtered = scratch.alloc<uchar>(cn*w*h);
+    bilateralFilter(srcImage, sigmaS, sigmaR, filtered);
+
+    QImage dst;
+    concatenateImageChannel(filtered, w, h, cn, dst);
 
     return dst;
 }
@@ -230,55 +117,32 @@ QImage SDFilterDialog::imageFilter(int inputFilterType)
 {
     int w = srcImage.width();
     int h = srcImage.height();
-    int hkw = 1;
-    int hkh = 1;
+    BorderType border = (BorderType)borderType;
 
-    float *filterKernelX;// = new float[(2*hkw+1)*(2*hkh+1)];
-    float *filterKernelY;// = new float[(2*hkw+1)*(2*hkh+1)];
+    // masks go through the convolution front-end, which also keeps 16 bit images deep
+    if (inputFilterType == FilterType::Laplacian4)
+        return convolveImage(srcImage, laplacian4, 3, 3, border);
+    if (inputFilterType == FilterType::Laplacian8)
+        return convolveImage(srcImage, laplacian8, 3, 3, border);
 
+    ScratchScope scratch;
+    uchar *filtered = scratch.alloc<uchar>(cn*w*h);
+
+    // filtering on the unpadded channels, Gx and Gy of the gradient operators in one pass
     switch (inputFilterType) {
     case FilterType::Roberts:
-        filterKernelX = robertsX;
-        filterKernelY = robertsY;
+        gradientFilter(rgb, w, h, cn, GradientRoberts, true, border, filtered);
         break;
     case FilterType::Sobel:
-        filterKernelX = sobelX;
-        filterKernelY = sobelY;
+        gradientFilter(rgb, w, h, cn, GradientSobel, true, border, filtered);
         break;
     case FilterType::Prewitt:
-        filterKernelX = prewittX;
-        filterKernelY = prewittY;
-        break;
-    case FilterType::Laplacian4:
-        filterKernelX = laplacian4;
-        break;
-    case FilterType::Laplacian8:
-        filterKernelX = laplacian8;
+        gradientFilter(rgb, w, h, cn, GradientPrewitt, true, border, filtered);
         break;
     }
 
-    int nw = w+hkw*2;
-    int nh = h+hkh*2;
-    rgbFilteredX = new uchar[3*w*h];
-    rgbFilteredY = new uchar[3*w*h];
-
-    // filtering
-    filterProc(rgbPadded, nw, nh, filterKernelX, hkw, hkh, rgbFilteredX);
-    if ((inputFilterType != (int)FilterType::Laplacian4) &&
-        (inputFilterType != (int)FilterType::Laplacian8) ) {
-        filterProc(rgbPadded, nw, nh, filterKernelY, hkw, hkh, rgbFilteredY);
-        for (int i=0; i<w*h*3; i++) {
-           rgbFilteredX[i] = (rgbFilteredX[i]+rgbFilteredY[i])/2;
-        }
-    }
-
     QImage dst;
-    concatenateImageChannel(rgbFilteredX, w, h, dst);
-
-    delete [] rgbFilteredX;
-    rgbFilteredX = nullptr;
-    delete [] rgbFilteredY;
-    rgbFilteredY = nullptr;
+    concatenateImageChannel(filtered, w, h, cn, dst);
 
     return dst;
 }
@@ -314,6 +178,21 @@ void SDFilterDialog::iniUI()
     LOGImageLabel->setAlignment(Qt::AlignCenter);
     LOGImageLabel->resize(250,250);
     LOGImageLabel->setSizePolicy(QSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed));
+
+    DOGImageLabel = new QLabel();
+    DOGImageLabel->setAlignment(Qt::AlignCenter);
+    DOGImageLabel->resize(250,250);
+    DOGImageLabel->setSizePolicy(QSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed));
+
+    bilateralImageLabel = new QLabel();
+    bilateralImageLabel->setAlignment(Qt::AlignCenter);
+    bilateralImageLabel->resize(250,250);
+    bilateralImageLabel->setSizePolicy(QSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed));
+
+    cannyImageLabel = new QLabel();
+    cannyImageLabel->setAlignment(Qt::AlignCenter);
+    cannyImageLabel->resize(250,250);
+    cannyImageLabel->setSizePolicy(QSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed));
     //paddedImageLabel = new QLabel();
     //paddedImageLabel->setAlignment(Qt::AlignCenter);
     //filteredSpectrumImageLabel = new QLabel();
@@ -349,6 +228,18 @@ void SDFilterDialog::iniUI()
     LOGLabel->setAlignment(Qt::AlignCenter);
     LOGLabel->resize(250,250);
 
+    DOGLabel = new QLabel(tr("DOG"));
+    DOGLabel->setAlignment(Qt::AlignCenter);
+    DOGLabel->resize(250,250);
+
+    bilateralLabel = new QLabel(tr("Bilateral"));
+    bilateralLabel->setAlignment(Qt::AlignCenter);
+    bilateralLabel->resize(250,250);
+
+    cannyLabel = new QLabel(tr("Canny"));
+    cannyLabel->setAlignment(Qt::AlignCenter);
+    cannyLabel->resize(250,250);
+
     // border type
     borderTypeLabel = new QLabel(tr("Border"));
     borderTypeLabel->setAlignment(Qt::AlignRight);
@@ -359,8 +250,8 @@ void SDFilterDialog::iniUI()
     borderTypeComboBox->addItem(tr("wrap"));
     borderTypeComboBox->addItem(tr("zero padding"));
 
-    // border size
-    sigmaLabel = new QLabel(tr("Size"));
+    // gaussian sigma of LoG and DoG
+    sigmaLabel = new QLabel(tr("Sigma"));
     sigmaSlider = new FloatSlider(Qt::Horizontal);
     sigmaEdit = new QLineEdit();
 
@@ -372,6 +263,44 @@ void SDFilterDialog::iniUI()
     sigmaSlider->setFloatStep(0.2f);
     sigmaEdit->setText(QString("%1").arg(sigma));
 
+    // spatial and range sigma of the bilateral filter
+    spatialSigmaLabel = new QLabel(tr("Spatial Sigma"));
+    spatialSigmaSlider = new FloatSlider(Qt::Horizontal);
+    spatialSigmaEdit = new QLineEdit();
+    spatialSigmaLabel->setAlignment(Qt::AlignRight);
+    spatialSigmaSlider->setFloatRange(8, 64);
+    spatialSigmaSlider->setFloatValue(spatialSigma);
+    spatialSigmaSlider->setFloatStep(1);
+    spatialSigmaEdit->setText(QString("%1").arg(spatialSigma));
+
+    rangeSigmaLabel = new QLabel(tr("Range Sigma"));
+    rangeSigmaSlider = new FloatSlider(Qt::Horizontal);
+    rangeSigmaEdit = new QLineEdit();
+    rangeSigmaLabel->setAlignment(Qt::AlignRight);
+    rangeSigmaSlider->setFloatRange(8, 128);
+    rangeSigmaSlider->setFloatValue(rangeSigma);
+    rangeSigmaSlider->setFloatStep(1);
+    rangeSigmaEdit->setText(QString("%1").arg(rangeSigma));
+
+    // canny thresholds
+    cannyLowLabel = new QLabel(tr("Canny Low"));
+    cannyLowSlider = new FloatSlider(Qt::Horizontal);
+    cannyLowEdit = new QLineEdit();
+    cannyLowLabel->setAlignment(Qt::AlignRight);
+    cannyLowSlider->setFloatRange(0, 1000);
+    cannyLowSlider->setFloatValue(cannyLow);
+    cannyLowSlider->setFloatStep(1);
+    cannyLowEdit->setText(QString("%1").arg(cannyLow));
+
+    cannyHighLabel = new QLabel(tr("Canny High"));
+    cannyHighSlider = new FloatSlider(Qt::Horizontal);
+    cannyHighEdit = new QLineEdit();
+    cannyHighLabel->setAlignment(Qt::AlignRight);
+    cannyHighSlider->setFloatRange(0, 1000);
+    cannyHighSlider->setFloatValue(cannyHigh);
+    cannyHighSlider->setFloatStep(1);
+    cannyHighEdit->setText(QString("%1").arg(cannyHigh));
+
     // filter type
     /*
     filterTypeLabel = new QLabel(tr("Filter"));
@@ -388,6 +317,10 @@ void SDFilterDialog::iniUI()
 
     // signal slot
     connect(sigmaSlider, SIGNAL(floatValueChanged(float)), this, SLOT(updateLOGImage(float)));
+    connect(spatialSigmaSlider, SIGNAL(floatValueChanged(float)), this, SLOT(updateBilateralImage(float)));
+    connect(rangeSigmaSlider, SIGNAL(floatValueChanged(float)), this, SLOT(updateBilateralImage(float)));
+    connect(cannyLowSlider, SIGNAL(floatValueChanged(float)), this, SLOT(updateCannyImage(float)));
+    connect(cannyHighSlider, SIGNAL(floatValueChanged(float)), this, SLOT(updateCannyImage(float)));
     //connect(borderTypeComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(updateDstImage(int)));
     //connect(filterTypeComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(updateDstImage(int)));
 
@@ -422,9 +355,15 @@ void SDFilterDialog::iniUI()
 
     QHBoxLayout *layout5 = new QHBoxLayout;
     layout5->addWidget(LOGImageLabel);
+    layout5->addWidget(DOGImageLabel);
+    layout5->addWidget(bilateralImageLabel);
+    layout5->addWidget(cannyImageLabel);
 
     QHBoxLayout *layout6 = new QHBoxLayout;
     layout6->addWidget(LOGLabel);
+    layout6->addWidget(DOGLabel);
+    layout6->addWidget(bilateralLabel);
+    layout6->addWidget(cannyLabel);
 
     /*
     QHBoxLayout *layout2 = new QHBoxLayout;
@@ -444,8 +383,22 @@ void SDFilterDialog::iniUI()
     layout7->addWidget(sigmaLabel, 2);
     layout7->addWidget(sigmaSlider, 6);
     layout7->addWidget(sigmaEdit, 2);
+    layout7->addWidget(spatialSigmaLabel, 2);
+    layout7->addWidget(spatialSigmaSlider, 6);
+    layout7->addWidget(spatialSigmaEdit, 2);
+    layout7->addWidget(rangeSigmaLabel, 2);
+    layout7->addWidget(rangeSigmaSlider, 6);
+    layout7->addWidget(rangeSigmaEdit, 2);
     //layout7->addStretch();
 
+    QHBoxLayout *layout9 = new QHBoxLayout;
+    layout9->addWidget(cannyLowLabel, 2);
+    layout9->addWidget(cannyLowSlider, 6);
+    layout9->addWidget(cannyLowEdit, 2);
+    layout9->addWidget(cannyHighLabel, 2);
+    layout9->addWidget(cannyHighSlider, 6);
+    layout9->addWidget(cannyHighEdit, 2);
+
     QHBoxLayout *layout8 = new QHBoxLayout;
     layout8->addStretch();
     layout8->addWidget(btnOK);
@@ -462,10 +415,55 @@ void SDFilterDialog::iniUI()
     mainlayout->addLayout(layout5);
     mainlayout->addLayout(layout6);
     mainlayout->addLayout(layout7);
+    mainlayout->addLayout(layout9);
     mainlayout->addLayout(layout8);
     setLayout(mainlayout);
 }
 
+/*
+*Summary: show a preview once its task has finished
+*Parameters:
+*    QImage *image : member that receives the preview
+*    QLabel *label : label that shows it
+*    const QFuture<QImage> &future : the filter task
+*Describtion:
+*    The result is dropped if a slider has already replaced the preview in the meantime.
+*/
+
+/*
+*Summary: run one preview filter on the preview pool
+*Describtion:
+*    The pool runs one preview per core, so the filters run single threaded there instead of
+*    opening an OpenMP team of their own on every pool thread. The OpenMP thread count is a
+*    setting of the calling thread, the pool threads belong to the dialog and keep it.
+*    Slider updates run on the GUI thread and still use all cores.
+*/
+
+QFuture<QImage> SDFilterDialog::startPreview(std::function<QImage()> filter)
+{
+    return QtConcurrent::run(&previewPool, [filter]() {
+#ifdef _OPENMP
+        omp_set_num_threads(1);
+#endif
+        return filter();
+    });
+}
+
+void SDFilterDialog::schedulePreview(QImage *image, QLabel *label, const QFuture<QImage> &future)
+{
+    QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcher<QImage>::finished, this, [=]() {
+        if (!label->pixmap() || label->pixmap()->isNull())
+        {
+            *image = watcher->result();
+            label->setPixmap(QPixmap::fromImage(*image).scaled(label->width(), label->height()));
+        }
+        watcher->deleteLater();
+    });
+    watcher->setFuture(future);
+    previews.addFuture(future);
+}
+
 void SDFilterDialog::setImage(QImage image, QLabel *label)
 {
     QPixmap pix;
@@ -482,5 +480,39 @@ void SDFilterDialog::updateLOGImage(float value)
         sigmaEdit->setText(QString("%1").arg(value));
         LOGImage = imageLOGFilter(sigma);
         LOGImageLabel->setPixmap(QPixmap::fromImage(LOGImage).scaled(LOGImageLabel->width(), LOGImageLabel->height()));
+        DOGImage = imageDOGFilter(sigma);
+        DOGImageLabel->setPixmap(QPixmap::fromImage(DOGImage).scaled(DOGImageLabel->width(), DOGImageLabel->height()));
+    }
+}
+
+void SDFilterDialog::updateBilateralImage(float value)
+{
+    if (QObject::sender() == spatialSigmaSlider)
+    {
+        spatialSigma = value;
+        spatialSigmaEdit->setText(QString("%1").arg(value));
+    }
+    else if (QObject::sender() == rangeSigmaSlider)
+    {
+        rangeSigma = value;
+        rangeSigmaEdit->setText(QString("%1").arg(value));
+    }
+    bilateralImage = imageBilateralFilter(spatialSigma, rangeSigma);
+    bilateralImageLabel->setPixmap(QPixmap::fromImage(bilateralImage).scaled(bilateralImageLabel->width(), bilateralImageLabel->height()));
+}
+
+void SDFilterDialog::updateCannyImage(float value)
+{
+    if (QObject::sender() == cannyLowSlider)
+    {
+        cannyLow = value;
+        cannyLowEdit->setText(QString("%1").arg(value));
+    }
+    else if (QObject::sender() == cannyHighSlider)
+    {
+        cannyHigh = value;
+        cannyHighEdit->setText(QString("%1").arg(value));
     }
+    cannyImage = cannyEdgeDetect(srcImage, 1.4f, (int)cannyLow, (int)cannyHigh);
+    cannyImageLabel->setPixmap(QPixmap::fromImage(cannyImage).scaled(cannyImageLabel->width(), cannyImageLabel->height()));
 }
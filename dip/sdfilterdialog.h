@@ -14,9 +14,19 @@
 #include <QPushButton>
 #include <QImage>
 #include <QComboBox>
+#include <QtConcurrent>
+#include <QFutureWatcher>
+#include <QFutureSynchronizer>
+#include <QThreadPool>
+#include <functional>
 #include "imageprocess.h"
 #include "padding.h"
+#include "gaussian.h"
+#include "bilateral.h"
+#include "edgedetect.h"
+#include "convolution.h"
 #include "floatslider.h"
+#include "scratcharena.h"
 #include <QApplication>
 #include <QDesktopWidget>
 
@@ -55,12 +65,8 @@ public:
     SDFilterDialog(QImage inputImage);
     ~SDFilterDialog()
     {
-        if (rgb)
-            delete [] rgb;
-        if (rgbPadded)
-            delete [] rgbPadded;
-        if (rgbFilteredX)
-            delete [] rgbFilteredX;
+        // the preview tasks read rgb
+        previews.waitForFinished();
         if (filterKernelX)
             delete [] filterKernelX;
     }
@@ -70,6 +76,10 @@ private:
     void iniUI();
     QImage imageFilter(int inputFilterType);
     QImage imageLOGFilter(float sigma);
+    QImage imageDOGFilter(float sigma);
+    QImage imageBilateralFilter(float sigmaS, float sigmaR);
+    QFuture<QImage> startPreview(std::function<QImage()> filter);
+    void schedulePreview(QImage *image, QLabel *label, const QFuture<QImage> &future);
     QImage srcImage;
     QImage robertsImage;
     QImage prewittImage;
@@ -77,15 +87,19 @@ private:
     QImage laplacian4Image;
     QImage laplacian8Image;
     QImage LOGImage;
+    QImage DOGImage;
+    QImage bilateralImage;
+    QImage cannyImage;
 
     QImage paddedImage;
     QImage filteredSpectrumImage;
     QImage dstImage;
 
+    int cn = 3;
+    ScratchScope dialogScratch;     // buffers that live as long as the dialog
     uchar *rgb = nullptr;
-    uchar *rgbPadded = nullptr;
-    uchar *rgbFilteredX = nullptr;
-    uchar *rgbFilteredY = nullptr;
+    QThreadPool previewPool;        // one preview per core, see startPreview()
+    QFutureSynchronizer<QImage> previews;
     float *filterKernelX = nullptr;
     float *filterKernelY = nullptr;
 
@@ -96,6 +110,9 @@ private:
     QLabel *laplacian4Label;
     QLabel *laplacian8Label;
     QLabel *LOGLabel;
+    QLabel *DOGLabel;
+    QLabel *bilateralLabel;
+    QLabel *cannyLabel;
 
     QLabel *srcImageLabel;
     QLabel *robertsImageLabel;
@@ -104,6 +121,9 @@ private:
     QLabel *laplacian4ImageLabel;
     QLabel *laplacian8ImageLabel;
     QLabel *LOGImageLabel;
+    QLabel *DOGImageLabel;
+    QLabel *bilateralImageLabel;
+    QLabel *cannyImageLabel;
 
     QLabel *paddedImageLabel;
     QLabel *filteredSpectrumImageLabel;
@@ -116,6 +136,28 @@ private:
     QLineEdit *sigmaEdit;
     QLabel *sigmaLabel;
 
+    // bilateral filter
+    float spatialSigma = 16;
+    FloatSlider *spatialSigmaSlider;
+    QLineEdit *spatialSigmaEdit;
+    QLabel *spatialSigmaLabel;
+
+    float rangeSigma = 30;
+    FloatSlider *rangeSigmaSlider;
+    QLineEdit *rangeSigmaEdit;
+    QLabel *rangeSigmaLabel;
+
+    // canny hysteresis thresholds on |dx| + |dy|
+    float cannyLow = 50;
+    FloatSlider *cannyLowSlider;
+    QLineEdit *cannyLowEdit;
+    QLabel *cannyLowLabel;
+
+    float cannyHigh = 150;
+    FloatSlider *cannyHighSlider;
+    QLineEdit *cannyHighEdit;
+    QLabel *cannyHighLabel;
+
     int borderType = 0;
     QLabel *borderTypeLabel;
     QComboBox *borderTypeComboBox;
@@ -131,6 +173,8 @@ private:
 private slots:
     void setImage(QImage image, QLabel *label);
     void updateLOGImage(float value);
+    void updateBilateralImage(float value);
+    void updateCannyImage(float value);
 };
 
 #endif // TDFILTERDIALOG_H
@@ -1,10 +1,11 @@
 #include "thresholddialog.h"
+#include "artifactcache.h"
 
 ThresholdDialog::ThresholdDialog(QImage inputImage)
 {
     srcImage = inputImage;
 
-    Threshold_Otsu(srcImage, dstImage);
+    process();
 
     iniUI();
 
@@ -21,6 +22,56 @@ void ThresholdDialog::iniUI()
     dstImageLabel = new QLabel();
     dstImageLabel->setAlignment(Qt::AlignCenter);
 
+    // global otsu or a local method
+    methodLabel = new QLabel(tr("Method"));
+    methodLabel->setAlignment(Qt::AlignRight);
+    methodComboBox = new QComboBox;
+    methodComboBox->addItem(tr("Otsu"));
+    methodComboBox->addItem(tr("Niblack"));
+    methodComboBox->addItem(tr("Sauvola"));
+    methodComboBox->addItem(tr("Bradley"));
+    methodComboBox->setCurrentIndex(method);
+
+    // number of otsu thresholds
+    thresholdsLabel = new QLabel(tr("Thresholds"));
+    thresholdsLabel->setAlignment(Qt::AlignRight);
+    thresholdsComboBox = new QComboBox;
+    for (int i = 1; i <= MaxThresholds; i++)
+        thresholdsComboBox->addItem(QString::number(i));
+    thresholdsComboBox->setCurrentIndex(thresholds-1);
+
+    // window size of the local methods
+    windowSizeLabel = new QLabel(tr("Window Size"));
+    windowSizeSlider = new FloatSlider(Qt::Horizontal);
+    windowSizeEdit = new QLineEdit();
+    windowSizeLabel->setAlignment(Qt::AlignRight);
+    windowSizeEdit->setMinimumWidth(16);
+    windowSizeSlider->setFloatRange(3, 201);
+    windowSizeSlider->setFloatStep(2);
+    windowSizeSlider->setFloatValue(windowSize);
+    windowSizeEdit->setText(QString("%1").arg(windowSize));
+
+    // k of the local methods
+    kLabel = new QLabel(tr("k"));
+    kSlider = new FloatSlider(Qt::Horizontal);
+    kEdit = new QLineEdit();
+    kLabel->setAlignment(Qt::AlignRight);
+    kEdit->setMinimumWidth(16);
+    kSlider->setFloatRange(-1, 1);
+    kSlider->setFloatStep(0.01f);
+    kSlider->setFloatValue(k);
+    kEdit->setText(QString::number(k, 'f', 2));
+
+    bool local = method != Otsu;
+    thresholdsComboBox->setEnabled(!local);
+    windowSizeSlider->setEnabled(local);
+    kSlider->setEnabled(local);
+
+    connect(methodComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(updateDstImage(int)));
+    connect(thresholdsComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(updateDstImage(int)));
+    connect(windowSizeSlider, SIGNAL(floatValueChanged(float)), this, SLOT(updateDstImage(float)));
+    connect(kSlider, SIGNAL(floatValueChanged(float)), this, SLOT(updateDstImage(float)));
+
     // three buttons
     btnOK = new QPushButton(tr("OK"));
     btnCancel = new QPushButton(tr("Cancel"));
@@ -34,6 +85,18 @@ void ThresholdDialog::iniUI()
     layout1->addWidget(srcImageLabel);
     layout1->addWidget(dstImageLabel);
 
+    QHBoxLayout *layout2 = new QHBoxLayout;
+    layout2->addWidget(methodLabel);
+    layout2->addWidget(methodComboBox);
+    layout2->addWidget(thresholdsLabel);
+    layout2->addWidget(thresholdsComboBox);
+    layout2->addWidget(windowSizeLabel, 2);
+    layout2->addWidget(windowSizeSlider, 4);
+    layout2->addWidget(windowSizeEdit, 1);
+    layout2->addWidget(kLabel, 1);
+    layout2->addWidget(kSlider, 4);
+    layout2->addWidget(kEdit, 1);
+
 //    srcLabel = new QLabel(tr("Original"));
 //    srcLabel->setAlignment(Qt::AlignCenter);
 
@@ -48,6 +111,7 @@ void ThresholdDialog::iniUI()
     // main layout
     QVBoxLayout *mainlayout = new QVBoxLayout;
     mainlayout->addLayout(layout1);
+    mainlayout->addLayout(layout2);
     mainlayout->addLayout(layout3);
     setLayout(mainlayout);
 }
@@ -58,102 +122,219 @@ void ThresholdDialog::setImage(QImage image, QLabel *label)
     pix.fromImage(image);
     label->setPixmap(pix);
 }
+
+void ThresholdDialog::process()
+{
+    switch (method)
+    {
+    case LocalNiblack:
+        dstImage = localThreshold(srcImage, Niblack, windowSize, k);
+        break;
+    case LocalSauvola:
+        dstImage = localThreshold(srcImage, Sauvola, windowSize, k);
+        break;
+    case LocalBradley:
+        dstImage = localThreshold(srcImage, Bradley, windowSize, k);
+        break;
+    default:
+        Threshold_Otsu(srcImage, thresholds, dstImage);
+        break;
+    }
+}
+
+void ThresholdDialog::updateDstImage(int index)
+{
+    if (QObject::sender() == methodComboBox)
+    {
+        method = index;
+        bool local = method != Otsu;
+        thresholdsComboBox->setEnabled(!local);
+        windowSizeSlider->setEnabled(local);
+        kSlider->setEnabled(local);
+
+        // the usual k of each method, setFloatValue() recomputes the image when k changes
+        float defaultK = method == LocalNiblack ? -0.2f : method == LocalSauvola ? 0.34f : 0.15f;
+        if (local && defaultK != k)
+        {
+            kSlider->setFloatValue(defaultK);
+            return;
+        }
+    }
+    else if (QObject::sender() == thresholdsComboBox)
+    {
+        thresholds = index + 1;
+    }
+
+    process();
+    dstImageLabel->setPixmap(QPixmap::fromImage(dstImage));
+}
+
+void ThresholdDialog::updateDstImage(float value)
+{
+    if (QObject::sender() == windowSizeSlider)
+    {
+        windowSize = (int)value | 1;   // odd
+        windowSizeEdit->setText(QString("%1").arg(windowSize));
+    }
+    else if (QObject::sender() == kSlider)
+    {
+        k = value;
+        kEdit->setText(QString::number(value, 'f', 2));
+    }
+
+    process();
+    dstImageLabel->setPixmap(QPixmap::fromImage(dstImage));
+}
 /*
-*Summary: Threshold segmentation by otsu algorithm
+*Summary: Threshold segmentation by (multi-level) otsu algorithm
 *Parameters:
-*    QImage &src_image : input original image
-*    QImage &dst_image : output opened image
+*    const QImage &src_image : input original image
+*    int thresholds : number of thresholds (1 - 4), the image is quantized to thresholds+1 levels
+*    QImage &dst_image : output Format_Grayscale8 image, the levels are spread evenly over [0, 255]
 *Describtion:
-*    intra-class variance / the variance within the class
-*    by selecting a structural template, the filled content can have certain geometric characteristics
+*    The thresholds maximize the between-class variance of the gray histogram, see otsuThresholds().
+*    Gray conversion and quantization are done in one row-major pass through a lookup table.
 */
 
-void ThresholdDialog::Threshold_Otsu(const QImage &src_image, QImage &dst_image)
+void ThresholdDialog::Threshold_Otsu(const QImage &src_image, int thresholds, QImage &dst_image)
 {
-    dst_image = src_image;
     double hist[256];
     normalizedHistogram(src_image, hist);
 
-    double omega[256];
-    double mu[256];
+    int t[MaxThresholds];
+    otsuThresholds(hist, thresholds, t);
+
+    // gray value --> output level, a pixel above k thresholds gets level k
+    uchar lut[256];
+    int level = 0;
+    for(int v = 0; v < 256; v++)
+    {
+        while (level < thresholds && v > t[level])
+            level++;
+        lut[v] = (uchar)(level * 255 / thresholds);
+    }
+
+    quantize(src_image, lut, dst_image);
+}
+
+/*
+*Summary: thresholds maximizing the between-class variance
+*Parameters:
+*    const double hist[256] : normalized gray histogram
+*    int thresholds : number of thresholds
+*    int *t : output thresholds in ascending order, class k holds the gray values in (t[k-1], t[k]]
+*Describtion:
+*    With the prefix sums P(i) and S(i) of hist[v] and v*hist[v], a class of the gray values (a, b]
+*    contributes (S(b)-S(a))^2 / (P(b)-P(a)) to the between-class variance (up to a constant).
+*    The best split of [0, b] into k classes is found by dynamic programming in O(thresholds * 256^2).
+*/
 
-    omega[0] = hist[0];
-    mu[0] = 0;
-    for(int i = 1; i < 256; i++)
+void ThresholdDialog::otsuThresholds(const double hist[256], int thresholds, int *t)
+{
+    const int L = 256;
+    int classes = thresholds + 1;
+
+    // prefix sums, P[i] and S[i] cover the gray values 0 .. i-1
+    double P[L+1], S[L+1];
+    P[0] = 0;
+    S[0] = 0;
+    for(int i = 0; i < L; i++)
+    {
+        P[i+1] = P[i] + hist[i];
+        S[i+1] = S[i] + i * hist[i];
+    }
+
+    // best[k][b] : best value for k+1 classes over the gray values 0 .. b-1, from[k][b] : start of the last class
+    static const double none = -1;
+    double best[MaxThresholds+1][L+1];
+    int from[MaxThresholds+1][L+1];
+    for(int b = 0; b <= L; b++)
     {
-        omega[i] = omega[i-1] + hist[i]; // cdf
-        mu[i] = mu[i-1] + i * hist[i];
+        best[0][b] = P[b] > 0 ? S[b] * S[b] / P[b] : 0;
+        from[0][b] = 0;
     }
-    double mean = mu[255]; // mean gray value
-    double max = 0;
-    int k_max = 0;
-    for(int k = 1; k < 255; k++)
+    for(int k = 1; k < classes; k++)
     {
-        double PA = omega[k]; // proportion of category A
-        double PB = 1 - omega[k]; // proportion of category B
-        double value = 0;
-        if( fabs(PA) > 0.001 && fabs(PB) > 0.001)
+        for(int b = 0; b <= L; b++)
         {
-            double MA = mu[k] / PA; // mean gray value of class A
-            double MB = (mean - mu[k]) / PB; // mean gray value of class B
-            value = PA * (MA - mean) * (MA - mean) + PB * (MB - mean) * (MB - mean); // the variance within the class
-
-            if (value > max)
+            best[k][b] = none;
+            from[k][b] = b;
+            for(int a = k; a < b; a++)
             {
-                max = value;
-                k_max = k;
+                if (best[k-1][a] == none)
+                    continue;
+                double w = P[b] - P[a];
+                double s = S[b] - S[a];
+                double value = best[k-1][a] + (w > 0 ? s * s / w : 0);
+                if (value > best[k][b])
+                {
+                    best[k][b] = value;
+                    from[k][b] = a;
+                }
             }
         }
     }
 
-    int threshold = k_max;
-
-    for(int i = 0; i < src_image.width(); i++)
+    // trace back the class boundaries, class k starts at gray value from[k][b]
+    int b = L;
+    for(int k = thresholds; k >= 1; k--)
     {
-       for(int j = 0; j < src_image.height(); j++)
-       {
-         QRgb pixel = src_image.pixel(i, j);
-         int r = qRed(pixel) * 0.3;
-         int g = qGreen(pixel) * 0.59;
-         int b = qBlue(pixel) * 0.11;
-         int rgb = r + g + b; // convert the color image to grayscale image
-         if (rgb > threshold) // binarize according to the calculated threshold
-         {
-           rgb = 255;
-         }else
-         {
-           rgb = 0;
-         }
-         QRgb newPixel = qRgb(rgb, rgb, rgb);
-         dst_image.setPixel(i, j, newPixel);
-       }
+        int a = from[k][b];
+        t[k-1] = a - 1;
+        b = a;
     }
-
 }
 
-void ThresholdDialog::normalizedHistogram(const QImage &image, double hist[256])
+/*
+*Summary: map every pixel's gray value through a lookup table
+*Parameters:
+*    const QImage &src_image : input original image
+*    const uchar lut[256] : gray value --> output value
+*    QImage &dst_image : output Format_Grayscale8 image
+*Describtion:
+*    Gray conversion (qGray, the same as the Format_Grayscale8 conversion used for the histogram)
+*    and the lookup are fused into one row-major pass, the rows are processed in parallel.
+*/
+
+void ThresholdDialog::quantize(const QImage &src_image, const uchar lut[256], QImage &dst_image)
 {
-    for(int i = 0; i < 256; i++)
-    {
-        hist[i] = 0.0;
-    }
-    int height = image.height();
-    int width = image.width();
-    int N = height * width;
-//    if(image.format() != QImage::Format_Indexed8)
-//    {
-//        return false;
-//    }
-    for(int i = 0; i < height; i++)
+    int width = src_image.width();
+    int height = src_image.height();
+    dst_image = QImage(width, height, QImage::Format_Grayscale8);
+
+    if (imageChannelCount(src_image) == 1)
     {
-        const quint8 *pData = (const quint8 *)image.constScanLine(i);
-        for(int j = 0; j < width; j++)
+        QImage gray = ArtifactCache::instance().grayImage(src_image);
+#pragma omp parallel for
+        for(int j = 0; j < height; j++)
         {
-            ++hist[ pData[j] ];
+            const uchar *p = gray.constScanLine(j);
+            uchar *d = dst_image.scanLine(j);
+            for(int i = 0; i < width; i++)
+                d[i] = lut[p[i]];
         }
+        return;
+    }
+
+    QImage rgb = src_image.convertToFormat(QImage::Format_RGB32);
+#pragma omp parallel for
+    for(int j = 0; j < height; j++)
+    {
+        const QRgb *p = (const QRgb *)rgb.constScanLine(j);
+        uchar *d = dst_image.scanLine(j);
+        for(int i = 0; i < width; i++)
+            d[i] = lut[qGray(p[i])];
     }
+}
+
+void ThresholdDialog::normalizedHistogram(const QImage &image, double hist[256])
+{
+    int N = image.height() * image.width();
+    // gray histogram, shared with the histogram view of the same image
+    QByteArray cached = ArtifactCache::instance().histogram(image, ImageChannel::Y);
+    const int *count = (const int *)cached.constData();
     for(int i = 0; i < 256; i++)
     {
-        hist[i] = hist[i] / N;
+        hist[i] = (double)count[i] / N;
     }
 }
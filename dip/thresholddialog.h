@@ -49,12 +49,36 @@ public:
     }
     QImage getImage() {return dstImage;}
 private:
-    void Threshold_Otsu(const QImage &src_image, QImage &dst_image);
+    enum { MaxThresholds = 4 };
+    enum { Otsu = 0, LocalNiblack, LocalSauvola, LocalBradley };
+    void process();
+    void Threshold_Otsu(const QImage &src_image, int thresholds, QImage &dst_image);
+    void otsuThresholds(const double hist[256], int thresholds, int *t);
+    void quantize(const QImage &src_image, const uchar lut[256], QImage &dst_image);
     void normalizedHistogram(const QImage &image, double hist[256]);
     void iniUI();
     QImage srcImage;
     QImage dstImage;
 
+    int method = Otsu;
+    QLabel *methodLabel;
+    QComboBox *methodComboBox;
+
+    int thresholds = 1;
+    QLabel *thresholdsLabel;
+    QComboBox *thresholdsComboBox;
+
+    // local methods
+    int windowSize = 31;
+    FloatSlider *windowSizeSlider;
+    QLineEdit *windowSizeEdit;
+    QLabel *windowSizeLabel;
+
+    float k = -0.2f;
+    FloatSlider *kSlider;
+    QLineEdit *kEdit;
+    QLabel *kLabel;
+
     QLabel *srcImageLabel;
     QLabel *dstImageLabel;
 
@@ -67,6 +91,8 @@ private:
 
 private slots:
     void setImage(QImage image, QLabel *label);
+    void updateDstImage(int index);
+    void updateDstImage(float value);
 };
 
 
@@ -0,0 +1,338 @@
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <string.h>
+
+#include "tiledimageitem.h"
+#include "imagehistory.h"
+#include "imageprocess.h"
+
+TiledImageItem::TiledImageItem(QGraphicsItem *parent)
+    : QGraphicsItem(parent)
+{
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);  // we need option->exposedRect
+    tiles.setMaxCost(256*1024);     // 256 MB of converted tiles
+}
+
+/*
+*Summary: replace the displayed image
+*Describtion:
+*    If size and format are unchanged only the tiles that differ from the previous
+*    image are invalidated (in every pyramid level already built), otherwise the
+*    pyramid and the tile cache are dropped and rebuilt lazily on the next paint.
+*/
+
+void TiledImageItem::setImage(const QImage &newImage)
+{
+    if (source.isNull() || source.size() != newImage.size() ||
+        source.format() != newImage.format() || newImage.depth() < 8)
+    {
+        prepareGeometryChange();
+        source = newImage;
+        levels.clear();
+        levels.resize(levelCount());
+        tiles.clear();
+        if (isHighBitDepth(source))
+            autoWindow();
+        else
+            windowLut.clear();
+        update();
+        return;
+    }
+
+    QVector<QRect> rects = changedTileRects(source, newImage, TileSize);
+    source = newImage;
+    if (rects.isEmpty())
+        return;
+
+    updateLevels(rects);
+    foreach (const QRect &rect, rects)
+        update(QRectF(rect));
+}
+
+/*
+*Summary: display window of 16 bit images
+*Parameters:
+*    int low : value shown as black
+*    int high : value shown as white, values in between are mapped linearly
+*/
+
+void TiledImageItem::setWindow(int low, int high)
+{
+    windowLut.resize(65536);
+    uchar *lut = windowLut.data();
+    float scale = high > low ? 255.0f/(high-low) : 0;
+    for (int v=0; v<65536; v++)
+        lut[v] = v <= low ? 0 : v >= high ? 255 : (uchar)((v-low)*scale + 0.5f);
+    tiles.clear();
+    update();
+}
+
+// the window spans the values found in the source, e.g. 0..4095 for 12 bit data
+void TiledImageItem::autoWindow()
+{
+    int height = source.height();
+    QVector<int> row_min(height), row_max(height);
+    int *rmin = row_min.data();
+    int *rmax = row_max.data();
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+    bool gray = source.format() == QImage::Format_Grayscale16;
+    QImage image = gray ? source : source.convertToFormat(QImage::Format_RGBX64);
+    int count = gray ? image.width() : 4*image.width();
+#pragma omp parallel for
+    for (int j=0; j<height; j++)
+    {
+        const quint16 *p = (const quint16 *)image.constScanLine(j);
+        int lo = 65535, hi = 0;
+        for (int i=0; i<count; i++)
+        {
+            if (!gray && (i & 3) == 3)
+                continue;       // padding channel of RGBX64
+            lo = qMin(lo, (int)p[i]);
+            hi = qMax(hi, (int)p[i]);
+        }
+        rmin[j] = lo;
+        rmax[j] = hi;
+    }
+#endif
+    int low = 65535, high = 0;
+    for (int j=0; j<height; j++)
+    {
+        low = qMin(low, rmin[j]);
+        high = qMax(high, rmax[j]);
+    }
+    if (high <= low)
+    {
+        low = 0;
+        high = 65535;
+    }
+    setWindow(low, high);
+}
+
+/*
+*Summary: map a 16 bit tile through the window
+*Return:
+*    Format_Grayscale8 tile for Format_Grayscale16, Format_RGB888 tile otherwise
+*/
+
+QImage TiledImageItem::windowTile(const QImage &tile) const
+{
+    const uchar *lut = windowLut.constData();
+    int width = tile.width();
+    int height = tile.height();
+    QImage dst;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+    if (tile.format() == QImage::Format_Grayscale16)
+    {
+        dst = QImage(width, height, QImage::Format_Grayscale8);
+        for (int j=0; j<height; j++)
+        {
+            const quint16 *p = (const quint16 *)tile.constScanLine(j);
+            uchar *d = dst.scanLine(j);
+            for (int i=0; i<width; i++)
+                d[i] = lut[p[i]];
+        }
+        return dst;
+    }
+    QImage rgb = tile.convertToFormat(QImage::Format_RGBX64);
+    dst = QImage(width, height, QImage::Format_RGB888);
+    for (int j=0; j<height; j++)
+    {
+        const QRgba64 *p = (const QRgba64 *)rgb.constScanLine(j);
+        uchar *d = dst.scanLine(j);
+        for (int i=0; i<width; i++)
+        {
+            d[3*i] = lut[p[i].red()];
+            d[3*i+1] = lut[p[i].green()];
+            d[3*i+2] = lut[p[i].blue()];
+        }
+    }
+#else
+    Q_UNUSED(lut);
+    dst = tile;
+#endif
+    return dst;
+}
+
+QRectF TiledImageItem::boundingRect() const
+{
+    return QRectF(0, 0, source.width(), source.height());
+}
+
+// number of pyramid levels, the coarsest one fits into a single tile
+int TiledImageItem::levelCount() const
+{
+    int count = 1;
+    int size = std::max(source.width(), source.height());
+    while (size > TileSize)
+    {
+        size = (size+1)/2;
+        count++;
+    }
+    return count;
+}
+
+/*
+*Summary: the source block of a 2x2 reduction
+*Parameters:
+*    const QImage &finer : level to reduce, at least 8 bits per pixel
+*    const QRect &src : block of even size whose top left corner lies inside finer
+*Describtion:
+*    Where the block reaches past the right or bottom edge of the level (odd level sizes,
+*    clipped tiles) the last column and row are replicated, so the block always halves
+*    exactly and the edge pixels are not stretched.
+*/
+
+static QImage reductionBlock(const QImage &finer, const QRect &src)
+{
+    QImage block = finer.copy(src);
+    QRect inside = src.intersected(finer.rect());
+    int w = inside.width();
+    int h = inside.height();
+    if (w == block.width() && h == block.height())
+        return block;
+
+    int bpp = block.depth()/8;
+    for (int j=0; j<h; j++)
+    {
+        uchar *row = block.scanLine(j);
+        for (int i=w; i<block.width(); i++)
+            memcpy(row + i*bpp, row + (w-1)*bpp, bpp);
+    }
+    for (int j=h; j<block.height(); j++)
+        memcpy(block.scanLine(j), block.constScanLine(h-1), block.width()*bpp);
+    return block;
+}
+
+const QImage &TiledImageItem::levelImage(int level)
+{
+    if (level == 0)
+        return source;
+    if (levels[level].isNull())
+    {
+        QImage finer = levelImage(level-1);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+        // the 64 bit rgb format is smoothed at 16 bits per channel, the window is applied per tile
+        if (!windowLut.isEmpty() && finer.format() != QImage::Format_RGBX64)
+            finer = finer.convertToFormat(QImage::Format_RGBX64);
+#endif
+        if (finer.depth() < 8)
+            finer = finer.convertToFormat(QImage::Format_ARGB32);
+        int width = (finer.width()+1)/2;
+        int height = (finer.height()+1)/2;
+        levels[level] = reductionBlock(finer, QRect(0, 0, 2*width, 2*height)).scaled(width, height,
+                                       Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    return levels[level];
+}
+
+quint64 TiledImageItem::tileKey(int level, int tx, int ty)
+{
+    return ((quint64)level << 48) | ((quint64)ty << 24) | (quint64)tx;
+}
+
+QPixmap *TiledImageItem::tilePixmap(int level, int tx, int ty)
+{
+    quint64 key = tileKey(level, tx, ty);
+    QPixmap *pixmap = tiles.object(key);
+    if (!pixmap)
+    {
+        const QImage &image = levelImage(level);
+        QRect rect(tx*TileSize, ty*TileSize, TileSize, TileSize);
+        QImage tile = image.copy(rect.intersected(image.rect()));
+        if (!windowLut.isEmpty())
+            tile = windowTile(tile);
+        pixmap = new QPixmap(QPixmap::fromImage(tile));
+        tiles.insert(key, pixmap, pixmap->width()*pixmap->height()*4/1024 + 1);
+    }
+    return pixmap;
+}
+
+void TiledImageItem::removeTiles(int level, const QRect &rect)
+{
+    for (int ty=rect.top()/TileSize; ty<=rect.bottom()/TileSize; ty++)
+        for (int tx=rect.left()/TileSize; tx<=rect.right()/TileSize; tx++)
+            tiles.remove(tileKey(level, tx, ty));
+}
+
+/*
+*Summary: propagate changed regions of the source image through the pyramid
+*Parameters:
+*    const QVector<QRect> &rects : changed rectangles in source image coordinates
+*Describtion:
+*    Each changed rectangle is mapped to the next coarser level (grown by one pixel
+*    for the smoothing filter), resampled from the finer level and painted in place.
+*    Levels which have not been built yet are left alone, they are built from the
+*    new source when they are needed.
+*/
+
+void TiledImageItem::updateLevels(const QVector<QRect> &rects)
+{
+    QVector<QRect> dirty = rects;
+    foreach (const QRect &rect, dirty)
+        removeTiles(0, rect);
+
+    for (int level=1; level<levels.size() && !levels[level].isNull(); level++)
+    {
+        QImage &coarse = levels[level];
+        const QImage &finer = levelImage(level-1);
+        QPainter painter(&coarse);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        for (int i=0; i<dirty.size(); i++)
+        {
+            QRect r = dirty[i];
+            QRect dst(QPoint(r.left()/2-1, r.top()/2-1), QPoint(r.right()/2+1, r.bottom()/2+1));
+            dst = dst.intersected(coarse.rect());
+            QRect src(dst.left()*2, dst.top()*2, dst.width()*2, dst.height()*2);
+            painter.drawImage(dst.topLeft(), reductionBlock(finer, src).scaled(dst.size(),
+                              Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+            removeTiles(level, dst);
+            dirty[i] = dst;
+        }
+    }
+}
+
+/*
+*Summary: draw the visible tiles of the pyramid level matching the current zoom
+*/
+
+void TiledImageItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    Q_UNUSED(widget);
+    if (source.isNull())
+        return;
+
+    // choose the coarsest level that still has at least one texel per screen pixel
+    qreal lod = option->levelOfDetailFromTransform(painter->worldTransform());
+    int level = 0;
+    while (level+1 < levels.size() && lod <= 0.5)
+    {
+        lod *= 2;
+        level++;
+    }
+    int scale = 1 << level;
+    const QImage &image = levelImage(level);
+
+    QRectF exposed = option->exposedRect.intersected(boundingRect());
+    if (exposed.isEmpty())
+        return;
+    int tileExtent = TileSize*scale;
+    int tx0 = (int)exposed.left() / tileExtent;
+    int ty0 = (int)exposed.top() / tileExtent;
+    int tx1 = std::min((int)exposed.right() / tileExtent, (image.width()-1) / TileSize);
+    int ty1 = std::min((int)exposed.bottom() / tileExtent, (image.height()-1) / TileSize);
+
+    painter->save();
+    painter->setClipRect(boundingRect(), Qt::IntersectClip);
+    if (lod < 1)    // minified, zooming in keeps the sharp pixels
+        painter->setRenderHint(QPainter::SmoothPixmapTransform);
+    for (int ty=ty0; ty<=ty1; ty++)
+    {
+        for (int tx=tx0; tx<=tx1; tx++)
+        {
+            QPixmap *pixmap = tilePixmap(level, tx, ty);
+            QRectF target(tx*tileExtent, ty*tileExtent, pixmap->width()*scale, pixmap->height()*scale);
+            painter->drawPixmap(target, *pixmap, QRectF(pixmap->rect()));
+        }
+    }
+    painter->restore();
+}
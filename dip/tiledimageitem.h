@@ -0,0 +1,48 @@
+#ifndef TILEDIMAGEITEM_H
+#define TILEDIMAGEITEM_H
+
+#include <QGraphicsItem>
+#include <QImage>
+#include <QPixmap>
+#include <QCache>
+#include <QVector>
+
+/*
+ * QGraphicsItem that displays a QImage as TileSize x TileSize tiles taken from a
+ * lazily built mipmap pyramid (level k is the image downscaled by 2^k).
+ * Only the tiles visible at the current zoom level are converted to pixmaps, and
+ * setImage() only rebuilds the tiles that differ from the previous image.
+ * Images with 16 bits per channel are shown through a window/level lookup table,
+ * by default the window spans the range of values found in the image.
+ */
+class TiledImageItem : public QGraphicsItem
+{
+public:
+    enum { TileSize = 256 };
+
+    TiledImageItem(QGraphicsItem *parent = nullptr);
+
+    void setImage(const QImage &newImage);
+    void setWindow(int low, int high);
+    const QImage &image() const { return source; }
+
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+
+private:
+    int levelCount() const;
+    const QImage &levelImage(int level);
+    QPixmap *tilePixmap(int level, int tx, int ty);
+    void updateLevels(const QVector<QRect> &rects);
+    void removeTiles(int level, const QRect &rect);
+    static quint64 tileKey(int level, int tx, int ty);
+    QImage windowTile(const QImage &tile) const;
+    void autoWindow();
+
+    QImage source;
+    QVector<QImage> levels;             // levels[k] for k >= 1, null until first needed
+    QCache<quint64, QPixmap> tiles;     // converted tiles, cost in KB
+    QVector<uchar> windowLut;           // 16 bit value to display value, empty for 8 bit images
+};
+
+#endif // TILEDIMAGEITEM_H
@@ -1,5 +1,10 @@
+#include <QMutex>
 #include "transform.h"
 #include "imageprocess.h"
+#include "artifactcache.h"
+#include "scratcharena.h"
+#include "convolution.h"
+#include "padding.h"
 
 #ifndef PI
 #define PI 3.1415926535
@@ -326,58 +331,10 @@ bool IFFT2D2QImage(complex<float>* y, int width, int height, QImage &dst)
 }
 
 
+// log magnitude spectrum, transformed at the FFTW friendly size instead of the next power of two (see fftPaddedSize())
 QImage imageFFT2D(QImage src)
 {
-    int i, j;
-    int width = src.width();
-    int height = src.height();
-
-    // radix-2
-    int w = 1, h = 1;
-    w = upper_power_of_two(width);
-    h = upper_power_of_two(height);
-
-    complex<float> *y, *x, *temp;
-    y = new complex<float>[w * h * 3];
-    x = new complex<float>[w * h * 3];
-    temp =  new complex<float>[w * h * 3];
-    memset(y, 0, w*h*3*sizeof(complex<float>));
-    memset(x, 0, w*h*3*sizeof(complex<float>));
-    memset(temp, 0, w*h*3*sizeof(complex<float>));
-
-    for(j = 0; j < h; j++)
-    {
-        for(i = 0; i < w; i++)
-        {
-            if(j < height && i < width)
-            {
-                QRgb rgb = src.pixel(i,j);
-                int r = qRed(rgb);
-                int g = qGreen(rgb);
-                int b = qBlue(rgb);
-
-                x[w * j * 3 + 3*i] = complex<float>(r, 0.0f);
-                x[w * j * 3 + 3*i+1] = complex<float>(g, 0.0f);
-                x[w * j * 3 + 3*i+2] = complex<float>(b, 0.0f);
-            }
-        }
-    }
-
-    if (FFT2D(x, width, height, y) == false)
-        return QImage();
-
-    delete [] x;
-
-    // fftshift
-    fftshift2D(y, w, h, temp);
-
-    QImage dst;
-    spectrum2QImage(temp, w, h, dst);
-
-    delete [] y;
-    delete [] temp;
-
-    return dst;
+    return ArtifactCache::instance().spectrumImage(src);
 }
 
 void imageFilterFFT2D1(QImage src, int r, int option, QImage &originalSpectrumImage,
@@ -463,140 +420,214 @@ void imageFilterFFT2D1(QImage src, int r, int option, QImage &originalSpectrumIm
 }
 
 
-void fftshift2D(fftwf_complex *src, int w, int h, fftwf_complex *dst)
+// the FFTW planner is not thread-safe (only fftwf_execute is), derived views are computed in the background
+QMutex &fftwPlannerMutex()
+{
+    static QMutex mutex;
+    return mutex;
+}
+
+// count transforms of consecutive w*h planes in one plan
+static fftwf_plan createPlanMany2D(int w, int h, int count, fftwf_complex *in, fftwf_complex *out, int sign)
+{
+    int dims[2] = {h, w};
+    QMutexLocker locker(&fftwPlannerMutex());
+    return fftwf_plan_many_dft(2, dims, count, in, nullptr, 1, w*h, out, nullptr, 1, w*h, sign, FFTW_ESTIMATE);
+}
+
+static void destroyPlan(fftwf_plan plan)
+{
+    QMutexLocker locker(&fftwPlannerMutex());
+    fftwf_destroy_plan(plan);
+}
+
+// dst(i, j) = src((i+dy)%h, (j+dx)%w) for every plane
+static void rotatePlanes(const fftwf_complex *src, int w, int h, int cn, int dx, int dy, fftwf_complex *dst)
 {
-    int i, j, ii, jj, c;
     int n = w*h;
-    for (c = 0; c<3; c++)
+    for (int c = 0; c<cn; c++)
     {
-        for(i = 0; i < h; i++)
+        for (int i = 0; i < h; i++)
         {
-            for(j = 0; j < w; j++)
+            const fftwf_complex *s = src + c*n + (i+dy)%h*w;
+            fftwf_complex *d = dst + c*n + i*w;
+            for (int j = 0; j < w; j++)
             {
-                if (i < h / 2)
-                    ii = i + h / 2;
-                else
-                    ii = i - h / 2;
-
-                if (j < w /2)
-                    jj = j + w / 2;
-                else
-                    jj = j - w / 2;
-
-                dst[c*n + i * w + j][0] = src[c*n + ii * w + jj][0];
-                dst[c*n + i * w + j][1] = src[c*n + ii * w + jj][1];
+                int jj = (j+dx)%w;
+                d[j][0] = s[jj][0];
+                d[j][1] = s[jj][1];
             }
         }
     }
 }
 
-void fftw2d(float *x, int w, int h, fftwf_complex *y)
+/*
+*Summary: move the zero frequency to the center and back
+*Parameters:
+*    fftwf_complex *src : cn spectra of w*h values
+*    fftwf_complex *dst : output, must not overlap src
+*Describtion:
+*    The zero frequency ends up at (w/2, h/2), the center used by generateFilter(). For odd
+*    lengths the two halves differ in size, so the shift is not its own inverse and
+*    ifftshift2D() has to undo it.
+*/
+
+void fftshift2D(fftwf_complex *src, int w, int h, int cn, fftwf_complex *dst)
 {
-    fftwf_plan plan;
-    int n = w*h;
-    fftwf_complex *temp = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * 3*n);
-    for (int i=0; i<3*n; i++)
-    {
-        temp[i][0]= x[i];
-        temp[i][1] = 0;
-    }
+    rotatePlanes(src, w, h, cn, (w+1)/2, (h+1)/2, dst);
+}
 
-    for (int i=0; i<3; i++)
+void ifftshift2D(fftwf_complex *src, int w, int h, int cn, fftwf_complex *dst)
+{
+    rotatePlanes(src, w, h, cn, w/2, h/2, dst);
+}
+
+// cn planes of w*h values, as many planes per plan as the scratch memory budget allows
+void fftw2d(const float *x, int w, int h, int cn, fftwf_complex *y)
+{
+    int n = w*h;
+    ScratchScope scratch("fftw2d");
+    int group = ScratchArena::fitUnits(n*(qint64)sizeof(fftwf_complex), cn);
+    fftwf_complex *temp = scratch.alloc<fftwf_complex>(group*n);
+    for (int c0=0; c0<cn; c0+=group)
     {
-        plan = fftwf_plan_dft_2d(h, w, temp+i*n, y+i*n, FFTW_FORWARD, FFTW_ESTIMATE);
+        int count = qMin(group, cn-c0);
+        for (int i=0; i<count*n; i++)
+        {
+            temp[i][0]= x[c0*n+i];
+            temp[i][1] = 0;
+        }
+        fftwf_plan plan = createPlanMany2D(w, h, count, temp, y+c0*n, FFTW_FORWARD);
         fftwf_execute(plan);
-        fftwf_destroy_plan(plan);
+        destroyPlan(plan);
     }
-
-    fftwf_free(temp);
 }
 
-void spectrum2QImage(fftwf_complex *s, int width, int height, QImage &dst)
+/*
+*Summary: log magnitude of cn spectra as an image
+*Parameters:
+*    const fftwf_complex *s : cn spectra of width*height values
+*    int cn : 1 gives a Format_Grayscale8 image, 3 a Format_RGB888 image
+*    QImage &dst : output image, every channel is scaled to [0, 255]
+*/
+
+// log magnitude of one spectrum into channel c of dst, m is scratch space for width*height values
+static void spectrumPlane2QImage(const fftwf_complex *sc, int width, int height, int cn, int c,
+                                 float *m, QImage &dst)
 {
     int pixel_num = width*height;
+    int i, j;
 
-    float *r = new float[width*height];
-    float *g = new float[width*height];
-    float *b = new float[width*height];
-    float max_r, max_g, max_b;
-    float min_r, min_g, min_b;
+    // magnitude -->use log to compress the dynamic range of the amplitude
+    for (i = 0; i < pixel_num; i++)
+        m[i] = log ( 1 + sqrt(1.0*sc[i][0] * sc[i][0] + sc[i][1] * sc[i][1]) );
 
-    dst = QImage(width, height, QImage::Format_RGB888);
-
-    int i, j;
-    for(j = 0; j < height; j++)
-    {
-        for(i = 0; i < width; i++)
-        {
-            // magnitude -->use log to compress the dynamic range of the amplitude
-            r[j*width+i] = log ( 1 + sqrt(1.0*s[j*width+i][0] * s[j*width+i][0] +
-                         s[j*width+i][1] * s[j*width+i][1]) );
-            g[j*width+i] = log ( 1+ sqrt(1.0*s[pixel_num+j*width+i][0] * s[pixel_num+j*width+i][0] +
-                         s[pixel_num+j*width+i][1] * s[pixel_num+j*width+i][1]) );
-            b[j*width+i] = log ( 1 + sqrt(1.0*s[2*pixel_num+j*width+i][0] * s[2*pixel_num+j*width+i][0] +
-                         s[2*pixel_num+j*width+i][1] * s[2*pixel_num+j*width+i][1]) );
-        }
-    }
-    max_r = r[0]; max_g = g[0]; max_b = b[0];
-    min_r = r[0]; min_g = g[0]; min_b = b[0];
+    float max_m = m[0];
+    float min_m = m[0];
     for (i=1; i<pixel_num; i++)
     {
-        max_r = r[i]>max_r ? r[i] : max_r;
-        max_g = g[i]>max_g ? g[i] : max_g;
-        max_b = b[i]>max_b ? b[i] : max_b;
-
-        min_r = r[i]<min_r ? r[i] : min_r;
-        min_g = g[i]<min_g ? g[i] : min_g;
-        min_b = b[i]<min_b ? b[i] : min_b;
+        max_m = m[i]>max_m ? m[i] : max_m;
+        min_m = m[i]<min_m ? m[i] : min_m;
     }
 
-    float temp_r, temp_g, temp_b;
-    float s_r = 255/(max_r-min_r);
-    float s_g = 255/(max_g-min_g);
-    float s_b = 255/(max_b-min_b);
+    float scale = 255/(max_m-min_m);
     for(j = 0; j < height; j++)
     {
+        uchar *p = dst.scanLine(j) + c;
         for(i = 0; i < width; i++)
-        {
-            temp_r = (r[j*width+i] - min_r)*s_r;
-            temp_g = (g[j*width+i] - min_g)*s_g;
-            temp_b = (b[j*width+i] - min_b)*s_b;
-
-            dst.setPixel(i, j, qRgb((int)temp_r, (int)temp_g, (int)temp_b));
-        }
+            p[i*cn] = (uchar)((m[j*width+i] - min_m)*scale);
     }
-    delete [] r; delete [] g; delete [] b;
 }
 
-bool IFFT2D2QImage(fftwf_complex *y, int w, int h, QImage &dst)
+void spectrum2QImage(const fftwf_complex *s, int width, int height, int cn, QImage &dst)
 {
-    int	i, j;
-    int n = w*h;
-    fftwf_plan plan;
-    fftwf_complex *x = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * 3*n);
+    int pixel_num = width*height;
 
-    for (i=0; i<3; i++)
-    {
-        plan = fftwf_plan_dft_2d(h, w, y+i*n, x+i*n, FFTW_BACKWARD, FFTW_ESTIMATE);
-        fftwf_execute(plan);
-        fftwf_destroy_plan(plan);
-    }
+    ScratchScope scratch("spectrum2QImage");
+    float *mag = scratch.alloc<float>(pixel_num);
+    dst = QImage(width, height, cn == 1 ? QImage::Format_Grayscale8 : QImage::Format_RGB888);
 
-    dst = QImage(w, h, QImage::Format_RGB888);
-    for(j = 0; j < h; j++)
-    {
-        for(i = 0; i < w; i++)
+    for (int c = 0; c < cn; c++)
+        spectrumPlane2QImage(s + c*pixel_num, width, height, cn, c, mag, dst);
+}
+
+/*
+*Summary: transform size of an image
+*Parameters:
+*    int w, int h : image size
+*    int &pw, int &ph : output transform size, w and h rounded up to lengths whose only prime
+*                       factors are 2, 3, 5 and 7 (see optimalFFTSize())
+*Describtion:
+*    FFTW falls back to its slow generic algorithms for large prime factors (a 4093 pixel wide
+*    crop is a prime), the next friendly length is never more than a few percent larger.
+*/
+
+void fftPaddedSize(int w, int h, int &pw, int &ph)
+{
+    pw = optimalFFTSize(w);
+    ph = optimalFFTSize(h);
+}
+
+// the part of a pw*ph transform that holds the w*h image, see padPlanesForFFT()
+static QRect fftImageRect(int pw, int ph, int w, int h)
+{
+    return QRect((pw-w)/2, (ph-h)/2, w, h);
+}
+
+/*
+*Summary: pad image planes to the transform size
+*Parameters:
+*    const float *planes : cn planes of w*h values
+*    int pw, int ph : transform size, see fftPaddedSize()
+*    float *padded : output cn planes of pw*ph values
+*Describtion:
+*    The image is centered and the margin mirrors it (BORDER_REFLECT_101), so the periodic
+*    extension of the transform continues the image smoothly instead of jumping to zero, which
+*    would add ringing and a bright cross to the spectrum.
+*/
+
+void padPlanesForFFT(const float *planes, int w, int h, int cn, int pw, int ph, float *padded)
+{
+    QRect r = fftImageRect(pw, ph, w, h);
+    for (int c=0; c<cn; c++)
+        copyMakeBorder(planes + c*w*h, w, h, 1, r.top(), ph-h-r.top(), r.left(), pw-w-r.left(),
+                       BORDER_REFLECT_101, (const float *)nullptr, padded + c*pw*ph);
+}
+
+// unnormalized inverse transforms of count spectra, the real parts inside crop divided by w*h,
+// x is scratch space for count*w*h values, planes receives count planes of the crop size
+static void inversePlanes(fftwf_complex *y, int w, int h, int count, fftwf_complex *x,
+                          const QRect &crop, float *planes)
+{
+    int n = w*h;
+    int cw = crop.width();
+    int ch = crop.height();
+    fftwf_plan plan = createPlanMany2D(w, h, count, y, x, FFTW_BACKWARD);
+    fftwf_execute(plan);
+    destroyPlan(plan);
+    for (int c = 0; c < count; c++)
+        for (int j = 0; j < ch; j++)
         {
-            int r = (int)(x[j*w+i][0]/n);
-            int g = (int)(x[j*w+i+n][0]/n);
-            int b = (int)(x[j*w+i+2*n][0]/n);
-            if (r>255) r=255;
-            if (g>255) g=255;
-            if (b>255) b=255;
-            dst.setPixel(i, j, qRgb(r,g,b));
+            const fftwf_complex *src = x + c*n + (j+crop.top())*w + crop.left();
+            float *dst = planes + (c*ch + j)*cw;
+            for (int i = 0; i < cw; i++)
+                dst[i] = src[i][0]/n;
         }
-    }
-    fftwf_free(x);
+}
+
+// the inverse transform as an image, 16 bit for high bit depth sources (see concatenateImagePlanes())
+bool IFFT2D2QImage(fftwf_complex *y, int w, int h, int cn, bool deep, QImage &dst)
+{
+    int n = w*h;
+    ScratchScope scratch("IFFT2D2QImage");
+
+    // one plane gives a gray image, as many planes per pass as the memory budget allows
+    float *planes = scratch.alloc<float>(cn*n);
+    int group = ScratchArena::fitUnits(n*(qint64)sizeof(fftwf_complex), cn);
+    fftwf_complex *x = scratch.alloc<fftwf_complex>(group*n);
+    for (int c0=0; c0<cn; c0+=group)
+        inversePlanes(y+c0*n, w, h, qMin(group, cn-c0), x, QRect(0, 0, w, h), planes+c0*n);
+    concatenateImagePlanes(planes, w, h, cn, deep, dst);
     return true;
 }
 
@@ -607,28 +638,26 @@ void imageFilterFFT2D(QImage src, int r, int option, QImage &originalSpectrumIma
     int w = src.width();
     int h = src.height();
     int n = w*h;
+    int cn = imageChannelCount(src);
 
-    float *channels = new float[n*3];
-    float *rr = channels;
-    float *gg = channels+n;
-    float *bb = channels+2*n;
-    splitImageChannel(src, rr, gg, bb);
+    ScratchScope scratch("imageFilterFFT2D");
+    float *channels = scratch.alloc<float>(n*cn);
+    splitImagePlanes(src, channels, cn);
 
-    fftwf_complex *y, *temp;
-    y = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * 3*n);
-    temp = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * 3*n);
+    fftwf_complex *y = scratch.alloc<fftwf_complex>(cn*n);
+    fftwf_complex *temp = scratch.alloc<fftwf_complex>(cn*n);
 
     // original spectrum
-    fftw2d(channels, w, h, y);
+    fftw2d(channels, w, h, cn, y);
 
     // fftshift
-    fftshift2D(y, w, h, temp);
+    fftshift2D(y, w, h, cn, temp);
 
     // original spectrum with fftshift
-    spectrum2QImage(temp, w, h, originalSpectrumImage);
+    spectrum2QImage(temp, w, h, cn, originalSpectrumImage);
 
     // filter
-    for (int c = 0; c<3; c++)
+    for (int c = 0; c<cn; c++)
     {
         for(i = 0; i < h; i++)
         {
@@ -650,52 +679,47 @@ void imageFilterFFT2D(QImage src, int r, int option, QImage &originalSpectrumIma
     }
 
     // filtered spectrum
-    spectrum2QImage(temp, w, h, filteredSpectrumImage);
+    spectrum2QImage(temp, w, h, cn, filteredSpectrumImage);
 
     // fftshift back for the filtered spectrum
-    fftshift2D(temp, w, h, y);
+    ifftshift2D(temp, w, h, cn, y);
 
     // filtered & fftshifted spectrum to QImage
-    IFFT2D2QImage(y, w, h, dstImage);
-
-    fftwf_free(y);
-    fftwf_free(temp);
+    IFFT2D2QImage(y, w, h, cn, isHighBitDepth(src), dstImage);
 }
 
+// one w*h transfer function, centered like the shifted spectrum and applied to every plane
 void generateFilter(int w, int h, int r, ImageFilterType type, float *filter)
 {
-    int i, j, c;
+    int i, j;
     int pixel_num = w*h;
     float area = r*r;
     int n = 2;
 
-    memset(filter, 0, 3*pixel_num*sizeof(float));
-    for (c = 0; c<3; c++)
+    memset(filter, 0, pixel_num*sizeof(float));
+    for(i = 0; i < h; i++)
     {
-        for(i = 0; i < h; i++)
+        for(j = 0; j < w; j++)
         {
-            for(j = 0; j < w; j++)
-            {
-                float area1 = (i-h/2)*(i-h/2) + (j-w/2)*(j-w/2);
-                switch ((int)type) {
-                case ImageFilterType::IdealLowPass:
-                    if (area1 <= area )// low-pass filter
-                        filter[c*pixel_num + i * w + j] = 1;
-                    break;
-                case ImageFilterType::IdealHighPass:
-                    if (area1 > area ) // high-pass filter
-                        filter[c*pixel_num + i * w + j] = 1;
-                    break;
-                case ImageFilterType::GaussainLowPass:
-                    filter[c*pixel_num + i * w + j] = exp(-area1 / (2*r*r));
-                    break;
-                case ImageFilterType::ButterworthLowPass:
-                    filter[c*pixel_num + i * w + j] = 1 / (1 + pow(sqrt(area1)/r,  2*n));
-                    break;
-                case ImageFilterType::ButterworthHighPass:
-                    filter[c*pixel_num + i * w + j] = 1 / (1 + pow(r/sqrt(area1),  2*n));
-                    break;
-                }
+            float area1 = (i-h/2)*(i-h/2) + (j-w/2)*(j-w/2);
+            switch ((int)type) {
+            case ImageFilterType::IdealLowPass:
+                if (area1 <= area )// low-pass filter
+                    filter[i * w + j] = 1;
+                break;
+            case ImageFilterType::IdealHighPass:
+                if (area1 > area ) // high-pass filter
+                    filter[i * w + j] = 1;
+                break;
+            case ImageFilterType::GaussainLowPass:
+                filter[i * w + j] = exp(-area1 / (2*r*r));
+                break;
+            case ImageFilterType::ButterworthLowPass:
+                filter[i * w + j] = 1 / (1 + pow(sqrt(area1)/r,  2*n));
+                break;
+            case ImageFilterType::ButterworthHighPass:
+                filter[i * w + j] = 1 / (1 + pow(r/sqrt(area1),  2*n));
+                break;
             }
         }
     }
@@ -703,60 +727,101 @@ void generateFilter(int w, int h, int r, ImageFilterType type, float *filter)
 
 void calcImageSpectrum(QImage src, QImage &dst)
 {
-    int w = src.width();
-    int h = src.height();
-    int n = w*h;
+    // shared with the frequency domain filter dialog, the image is transformed only once
+    dst = ArtifactCache::instance().spectrumImage(src);
+}
 
-    float *channels = new float[n*3];
-    float *rr = channels;
-    float *gg = channels+n;
-    float *bb = channels+2*n;
-    splitImageChannel(src, rr, gg, bb);
+// the filtered spectra as an image and the crop of their inverse transforms as cn planes, see imageFilterFFT2D()
+static void filterSpectra(const fftwf_complex *y, int w, int h, int cn, const float *filter, const QRect &crop,
+                          QImage &filteredSpectrumImage, float *planes)
+{
+    int n = w*h;
+    int cropped = crop.width()*crop.height();
 
-    fftwf_complex *y, *temp;
-    y = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * 3*n);
-    temp = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * 3*n);
+    ScratchScope scratch;
+    float *mag = scratch.alloc<float>(n);
+    int group = ScratchArena::fitUnits(2*n*(qint64)sizeof(fftwf_complex), cn);
+    fftwf_complex *yy = scratch.alloc<fftwf_complex>(group*n);
+    fftwf_complex *temp = scratch.alloc<fftwf_complex>(group*n);
 
-    // original spectrum
-    fftw2d(channels, w, h, y);
-
-    // fftshift
-    fftshift2D(y, w, h, temp);
+    filteredSpectrumImage = QImage(w, h, cn == 1 ? QImage::Format_Grayscale8 : QImage::Format_RGB888);
+    for (int c0=0; c0<cn; c0+=group)
+    {
+        int count = qMin(group, cn-c0);
+        for (int c=0; c<count; c++)
+        {
+            // filter
+            const fftwf_complex *s = y + (c0+c)*n;
+            fftwf_complex *f = yy + c*n;
+            for (int i = 0; i<n; i++)
+            {
+                f[i][0] = s[i][0]*filter[i];
+                f[i][1] = s[i][1]*filter[i];
+            }
 
-    // original spectrum
-    spectrum2QImage(temp, w, h, dst);
+            // filtered spectrum
+            spectrumPlane2QImage(f, w, h, cn, c0+c, mag, filteredSpectrumImage);
+        }
 
-    fftwf_free(y);
-    fftwf_free(temp);
-    delete [] channels;
+        // fftshift back, then the filtered spectra are free for the inverse transform
+        ifftshift2D(yy, w, h, count, temp);
+        inversePlanes(temp, w, h, count, yy, crop, planes+c0*cropped);
+    }
 }
 
-void imageFilterFFT2D(fftwf_complex *y, int w, int h, float *filter,
-                      QImage &filteredSpectrumImage, QImage &dstImage)
+/*
+*Summary: filter shifted spectra and transform them back
+*Parameters:
+*    const fftwf_complex *y : cn fftshifted spectra of w*h values
+*    const float *filter : w*h transfer function (see generateFilter()), applied to every plane
+*    QImage &filteredSpectrumImage : log magnitude of the filtered spectra
+*    QImage &dstImage : filtered image, 16 bit for deep sources (see concatenateImagePlanes())
+*    bool deep : whether the source image has 16 bit channels
+*    const QSize &size : size of the image padded to w*h by padPlanesForFFT(), dstImage is cropped
+*                        back to it, an empty size keeps the whole transform
+*Describtion:
+*    The planes are filtered, shifted back and transformed in passes of as many planes as the
+*    scratch memory budget allows (see ScratchArena::fitUnits()), with a tight budget one plane
+*    at a time. A pass needs two spectra per plane.
+*/
+
+void imageFilterFFT2D(const fftwf_complex *y, int w, int h, int cn, const float *filter,
+                      QImage &filteredSpectrumImage, QImage &dstImage, bool deep, const QSize &size)
 {
-    int i;
-    int n = w*h;
-
-    fftwf_complex *yy = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * 3*n);
-    memcpy(yy, y, 3*n*sizeof(fftwf_complex));
+    QRect crop = size.isEmpty() ? QRect(0, 0, w, h) : fftImageRect(w, h, size.width(), size.height());
 
-    // filter
-    for (i = 0; i<3*n; i++)
-    {
-        yy[i][0] *= filter[i];
-        yy[i][1] *= filter[i];
-    }
+    ScratchScope scratch("imageFilterFFT2D");
+    float *planes = scratch.alloc<float>(cn*crop.width()*crop.height());
+    filterSpectra(y, w, h, cn, filter, crop, filteredSpectrumImage, planes);
 
-    // filtered spectrum
-    spectrum2QImage(yy, w, h, filteredSpectrumImage);
+    // planes to QImage
+    concatenateImagePlanes(planes, crop.width(), crop.height(), cn, deep, dstImage);
+}
 
-    // fftshift
-    fftwf_complex *temp = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * 3*n);
-    fftshift2D(yy, w, h, temp);
+/*
+*Summary: filter only the luma of a color image, the chroma is kept
+*Parameters:
+*    const fftwf_complex *y : fftshifted spectrum of the padded y plane, w*h values
+*                             (see ArtifactCache::shiftedSpectrum())
+*    const float *ycrcb : y, cr and cb planes of the image (see ArtifactCache::lumaChromaPlanes())
+*    const QSize &size : image size, the y plane was padded to w*h by padPlanesForFFT()
+*    other parameters as for imageFilterFFT2D()
+*Describtion:
+*    One inverse transform instead of three per update, low and high pass filters act on
+*    brightness detail, which is where the eye sees them.
+*/
+
+void imageFilterLumaFFT2D(const fftwf_complex *y, int w, int h, const float *ycrcb, const float *filter,
+                          QImage &filteredSpectrumImage, QImage &dstImage, bool deep, const QSize &size)
+{
+    int n = size.width()*size.height();
 
-    // spectrum to QImage
-    IFFT2D2QImage(temp, w, h, dstImage);
+    ScratchScope scratch("imageFilterLumaFFT2D");
+    float *luma = scratch.alloc<float>(n);
+    filterSpectra(y, w, h, 1, filter, fftImageRect(w, h, size.width(), size.height()), filteredSpectrumImage, luma);
 
-    fftwf_free(yy);
-    fftwf_free(temp);
+    // filtered luma with the original chroma
+    float *rgb = scratch.alloc<float>(3*n);
+    ycrcb2rgb(luma, ycrcb+n, ycrcb+2*n, n, rgb, rgb+n, rgb+2*n);
+    concatenateImagePlanes(rgb, size.width(), size.height(), 3, deep, dstImage);
 }
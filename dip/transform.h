@@ -2,6 +2,7 @@
 #define TRANSFORM_H
 #include <complex>
 #include <QImage>
+#include <QMutex>
 #include "fftw3.h"
 
 enum ImageFilterType{
@@ -15,13 +16,20 @@ enum ImageFilterType{
 QImage imageFFT2D(QImage src);
 void imageFilterFFT2D(QImage src, int r, int option, QImage &originalSpectrumImage,
                       QImage &filteredSpectrumImage, QImage &dstImage);
-void imageFilterFFT2D(fftwf_complex *y, int w, int h, float *filter,
-                      QImage &filteredSpectrumImage, QImage &dstImage);
+void imageFilterFFT2D(const fftwf_complex *y, int w, int h, int cn, const float *filter,
+                      QImage &filteredSpectrumImage, QImage &dstImage, bool deep = false,
+                      const QSize &size = QSize());
+void imageFilterLumaFFT2D(const fftwf_complex *y, int w, int h, const float *ycrcb, const float *filter,
+                          QImage &filteredSpectrumImage, QImage &dstImage, bool deep, const QSize &size);
 void generateFilter(int w, int h, int r, ImageFilterType type, float *filter);
-void fftw2d(float *x, int w, int h, fftwf_complex *y);
-void fftshift2D(fftwf_complex *src, int w, int h, fftwf_complex *dst);
+void fftw2d(const float *x, int w, int h, int cn, fftwf_complex *y);
+void fftPaddedSize(int w, int h, int &pw, int &ph);
+void padPlanesForFFT(const float *planes, int w, int h, int cn, int pw, int ph, float *padded);
+void fftshift2D(fftwf_complex *src, int w, int h, int cn, fftwf_complex *dst);
+void ifftshift2D(fftwf_complex *src, int w, int h, int cn, fftwf_complex *dst);
 void calcImageSpectrum(QImage src, QImage &dst);
-void spectrum2QImage(fftwf_complex *s, int width, int height, QImage &dst);
+void spectrum2QImage(const fftwf_complex *s, int width, int height, int cn, QImage &dst);
+QMutex &fftwPlannerMutex();
 
 
 #endif // TRANSFORM_H